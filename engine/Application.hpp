@@ -7,6 +7,7 @@ import engine.window;
 import engine.renderer;
 import engine.renderSystem;
 import engine.device;
+import engine.pipelineCache;
 
 namespace gears {
    class Application {
@@ -23,12 +24,16 @@ namespace gears {
           : _window{windowName, width, height},
             _device{_window},
             _renderer{_window, _device},
-            _renderSystem{_device, _renderer.getSwapChainRenderPass()} {}
+            _pipelines{_device},
+            _renderSystem{_device, _pipelines, _renderer.getSwapChainRenderPass()} {
+         _renderer.setPipelineRegistry(&_pipelines);
+      }
 
       WindowManager _windowManager;
       Window _window;
       PhysicalDevice _device;
       Renderer _renderer;
+      PipelineRegistry _pipelines; // saves the pipeline cache when destroyed
       EngineRenderSystem _renderSystem;
    };
 } // namespace gears
\ No newline at end of file
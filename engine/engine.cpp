@@ -12,10 +12,15 @@ import movementController;
 import engine.camera;
 import engine.logger;
 import engineModel;
+import engine.culling;
+import engine.commandPools;
+import engine.profiler;
 
 namespace gears {
 
    Engine::Engine(uint32_t width, uint32_t height, const std::string& windowName) : Application(width, height, windowName) {
+      _renderSystem.setJobSystem(&_jobSystem);
+      _renderSystem.setGpuProfiler(&_renderer.gpuProfiler());
       _loadGameObjects();
    }
 
@@ -42,18 +47,28 @@ namespace gears {
 
       EngineCamera camera{};
 
-      auto viewerObject = EngineGameObject::createGameObject();
+      TransformComponent viewerTransform{};
 
       MovementController cameraController{};
       Mouse mouse{_window};
       mouse.update();
 
       auto prevTime = std::chrono::high_resolution_clock::now();
+      auto prevStatistics = prevTime;
+      CullingSystem::Statistics prevCulling{};
 
       while (!_window.shouldClose()) {
-         glfwPollEvents();
-         mouse.update();
-         _windowManager.removeClosedWindows();
+         if (profiler) profiler->beginFrame();
+         {
+            ProfileScope scope{"poll events"};
+            glfwPollEvents();
+            mouse.update();
+            _windowManager.removeClosedWindows();
+         }
+         {
+            ProfileScope scope{"asset streamer"};
+            _assetStreamer.update();
+         }
 
          auto currentTime = std::chrono::high_resolution_clock::now();
          float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - prevTime).count();
@@ -61,42 +76,75 @@ namespace gears {
 
          glfwSetMouseButtonCallback(_window.getWindow(), mouseCallback); // se RMB e' premuto muove la camera senno' muove il mouse
          if (glfwGetMouseButton(_window.getWindow(), GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
-            cameraController.moveInPlaneYXZ(_window.getWindow(), mouse, deltaTime, viewerObject);
-            camera.setViewYXZ(viewerObject.transform.position, viewerObject.transform.rotation);
+            cameraController.moveInPlaneYXZ(_window.getWindow(), mouse, deltaTime, viewerTransform);
+            camera.setViewYXZ(viewerTransform.position, viewerTransform.rotation);
          }
 
          float aspect = _renderer.getAspectRatio();
          camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 50.f);
 
-         if (auto commandBuffer = _renderer.beginFrame()) {
-            _renderer.beginSwapChainRenderPass(commandBuffer);
-            _renderSystem.renderGameObjects(commandBuffer, _gameObjects, camera);
-            _renderer.endSwapChainRenderPass(commandBuffer);
-            _renderer.endFrame();
+         {
+            ProfileScope scope{"render"};
+            if (auto commandBuffer = _renderer.beginFrame()) {
+               const RenderPassContext renderPass = _renderer.getSwapChainRenderPassContext();
+               _renderer.beginSwapChainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+               _renderSystem.renderGameObjects(commandBuffer, _renderer.getFrameIndex(), _gameObjects, _transforms, camera, &renderPass);
+               _renderer.endSwapChainRenderPass(commandBuffer);
+               _renderer.endFrame();
+
+               const auto& culling = _renderSystem.cullingSystem().statistics();
+               if (culling.visible != prevCulling.visible || culling.culled != prevCulling.culled) {
+                  logger->logTrace("{} objects visible, {} culled ({:.3f} ms)", culling.visible, culling.culled, culling.milliseconds);
+                  prevCulling = culling;
+               }
+            }
+         }
+
+         if (profiler) {
+            profiler->endFrame();
+            if (profiler->isEnabled() && currentTime - prevStatistics > std::chrono::seconds{5}) {
+               profiler->logStatistics();
+               prevStatistics = currentTime;
+            }
          }
       }
 
       vkDeviceWaitIdle(_device.device());
+      _renderer.gpuProfiler().readPendingResults();
       logger->log("terminating engine");
    }
 
    void Engine::_loadGameObjects() {
-      std::shared_ptr<EngineModel> model = EngineModel::createModelFromFile(_device, "flat_vase.obj");
-
+      _placeholderModel = EngineModel::createPlaceholder(_device);
 
       auto flatVase = EngineGameObject::createGameObject();
-      flatVase.model = model;
-      flatVase.transform.position = {-.5f, .5f, 2.5f};
-      flatVase.transform.scale = {3.f, 1.5f, 3.f};
+      TransformComponent flatVaseTransform{};
+      flatVaseTransform.position = {-.5f, .5f, 2.5f};
+      flatVaseTransform.scale = {3.f, 1.5f, 3.f};
+      _streamModel(flatVase, "flat_vase.obj");
+      _transforms.add(flatVase.getId(), flatVaseTransform);
       _gameObjects.push_back(std::move(flatVase));
-      logger->log("Loaded model \"flat_vase.obj\"");
 
-      model = EngineModel::createModelFromFile(_device, "smooth_vase.obj");
       auto smoothVase = EngineGameObject::createGameObject();
-      smoothVase.model = model;
-      smoothVase.transform.position = {.5f, .5f, 2.5f};
-      smoothVase.transform.scale = {3.f, 1.5f, 3.f};
+      TransformComponent smoothVaseTransform{};
+      smoothVaseTransform.position = {.5f, .5f, 2.5f};
+      smoothVaseTransform.scale = {3.f, 1.5f, 3.f};
+      _streamModel(smoothVase, "smooth_vase.obj");
+      _transforms.add(smoothVase.getId(), smoothVaseTransform);
       _gameObjects.push_back(std::move(smoothVase));
-      logger->log("Loaded model \"smooth_vase.obj\"");
+   }
+
+   void Engine::_streamModel(EngineGameObject& object, const std::string& filepath) {
+      object.model = _placeholderModel;
+
+      _assetStreamer.requestModel(filepath, [this, id = object.getId(), filepath](std::shared_ptr<EngineModel> model) {
+         for (auto& obj : _gameObjects) {
+            if (obj.getId() == id) {
+               obj.model = std::move(model);
+               break;
+            }
+         }
+         logger->log("Loaded model \"{}\"", filepath);
+      });
    }
 } // namespace gears
\ No newline at end of file
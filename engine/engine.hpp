@@ -2,9 +2,14 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #include "Application.hpp"
 import engine.gameObject;
+import engine.assetStreamer;
+import engine.transformSystem;
+import engine.jobSystem;
+import engineModel;
 
 namespace gears {
    class Engine final : public Application {
@@ -16,6 +21,13 @@ namespace gears {
 
    private:
       void _loadGameObjects();
+      // object starts with the placeholder model and switches over once filepath is resident
+      void _streamModel(EngineGameObject& object, const std::string& filepath);
+
       std::vector<EngineGameObject> _gameObjects;
+      TransformSystem _transforms; // authoritative transforms of the rendered objects
+      std::shared_ptr<EngineModel> _placeholderModel;
+      AssetStreamer _assetStreamer{_device};
+      JobSystem _jobSystem; // culling and command buffer recording, one thread per core
    };
 } // namespace gears
@@ -0,0 +1,156 @@
+module;
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+export module engine.assetStreamer;
+import engine.device;
+import engine.logger;
+import engine.threadPool;
+import engineModel;
+
+namespace gears {
+
+   // loads models without blocking the frame loop: files are parsed on a thread pool and every mesh
+   // that finished parsing since the last update() is uploaded with a single fenced submission. requests
+   // for a file that is already loading share its parse and its model
+   export class AssetStreamer {
+   public:
+      using ModelCallback = std::function<void(std::shared_ptr<EngineModel>)>;
+
+      AssetStreamer(PhysicalDevice& device, uint32_t threadCount = 0);
+      ~AssetStreamer() = default;
+
+      AssetStreamer(const AssetStreamer&) = delete;
+      AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+      // callback is invoked from update() once the model is resident on the gpu, must be called from the
+      // same thread as update()
+      void requestModel(const std::string& filepath, ModelCallback callback);
+
+      // must be called from the thread that owns the device, once per frame
+      void update();
+
+      bool isIdle() const { return _pendingRequests == 0; }
+
+   private:
+      struct Request {
+         std::string filepath;
+         std::vector<ModelCallback> callbacks; // only touched by the thread calling update()
+         EngineModel::FileData fileData{};
+         std::exception_ptr error{};
+      };
+
+      struct Upload {
+         std::unique_ptr<TransferBatch> batch;
+         std::vector<std::pair<std::shared_ptr<EngineModel>, std::shared_ptr<Request>>> models;
+      };
+
+      void _submitParsedRequests();
+      void _finish(Request& request, const std::shared_ptr<EngineModel>& model);
+
+      PhysicalDevice& _device;
+      size_t _pendingRequests = 0;
+      // from the first request for a file until its callbacks have been invoked
+      std::unordered_map<std::string, std::shared_ptr<Request>> _loadingRequests;
+
+      std::mutex _mutex;
+      std::vector<std::shared_ptr<Request>> _parsedRequests; // guarded by _mutex
+      std::deque<Upload> _uploads;
+
+      ThreadPool _threadPool; // declared last so the workers stop before the rest is destroyed
+   };
+
+   //  ========================================== implementation ==========================================
+
+   AssetStreamer::AssetStreamer(PhysicalDevice& device, uint32_t threadCount) : _device{device}, _threadPool{threadCount} {}
+
+   void AssetStreamer::requestModel(const std::string& filepath, ModelCallback callback) {
+      _pendingRequests++;
+
+      auto [it, inserted] = _loadingRequests.try_emplace(filepath);
+      if (!inserted) {
+         it->second->callbacks.push_back(std::move(callback));
+         return;
+      }
+
+      auto request = std::make_shared<Request>();
+      request->filepath = filepath;
+      request->callbacks.push_back(std::move(callback));
+      it->second = request;
+
+      _threadPool.submit([this, request] {
+         try {
+            // the pool already loads several files at once, one thread per file
+            request->fileData = EngineModel::FileData::load(request->filepath, 1);
+         } catch (...) {
+            request->error = std::current_exception();
+         }
+
+         std::lock_guard lock{_mutex};
+         _parsedRequests.push_back(request);
+      });
+   }
+
+   void AssetStreamer::update() {
+      _submitParsedRequests();
+
+      // fences on the same queue signal in submission order
+      while (!_uploads.empty() && _uploads.front().batch->isComplete()) {
+         for (auto& [model, request] : _uploads.front().models) _finish(*request, model);
+         _uploads.pop_front();
+      }
+   }
+
+   void AssetStreamer::_finish(Request& request, const std::shared_ptr<EngineModel>& model) {
+      // erased first so callbacks requesting the same file again start a new load, the caller keeps request alive
+      _loadingRequests.erase(request.filepath);
+
+      for (auto& callback : request.callbacks) {
+         if (model) callback(model);
+         _pendingRequests--;
+      }
+   }
+
+   void AssetStreamer::_submitParsedRequests() {
+      std::vector<std::shared_ptr<Request>> parsedRequests;
+      {
+         std::lock_guard lock{_mutex};
+         parsedRequests.swap(_parsedRequests);
+      }
+      if (parsedRequests.empty()) return;
+
+      Upload upload{std::make_unique<TransferBatch>(_device)};
+      for (auto& request : parsedRequests) {
+         // out of device memory fails just this model, the ones already in the batch still get submitted
+         std::shared_ptr<EngineModel> model;
+         try {
+            if (request->error) std::rethrow_exception(request->error);
+            model = std::make_shared<EngineModel>(_device, request->fileData, *upload.batch);
+         } catch (const std::exception& e) {
+            logger->error("failed to load model \"{}\": {}", request->filepath, e.what());
+         }
+         request->fileData = {}; // the batch has its own copy, this unmaps the mesh cache
+
+         if (!model) {
+            _finish(*request, nullptr);
+            continue;
+         }
+         upload.models.emplace_back(std::move(model), std::move(request));
+      }
+
+      if (upload.models.empty()) return;
+
+      upload.batch->submit();
+      _uploads.push_back(std::move(upload));
+   }
+} // namespace gears
@@ -0,0 +1,686 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+export module engine.benchmark;
+import engine.logger;
+import engine.meshCache;
+import engine.device;
+import engine.window;
+import engine.windowManager;
+import engineModel;
+import engine.camera;
+import engine.gameObject;
+import engine.offscreenTarget;
+import engine.renderSystem;
+import engine.pipelineCache;
+import engine.transformSystem;
+import engine.bounds;
+import engine.jobSystem;
+import engine.commandPools;
+import engine.gpuProfiler;
+import engine.profiler;
+import engine.swapChain;
+
+namespace gears {
+
+   // entry point for `Gears --benchmark <name> [args...]`, results are written through the logger
+   export void runBenchmark(const std::vector<std::string>& args);
+   // entry point for `Gears --headless [frames] [objects] [trace.json]`: renders frames offscreen with the
+   // profiler enabled, logs the frame time percentiles and writes a chrome trace
+   export void runHeadless(const std::vector<std::string>& args);
+
+   //  ========================================== implementation ==========================================
+
+   template <typename Func>
+   double measureMilliseconds(uint32_t iterations, Func&& func) {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < iterations; i++) func();
+      auto end = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+   }
+
+   // compares parsing the obj against mapping the mesh cache and copying it into a staging-like buffer
+   void benchmarkMeshLoading(std::vector<std::string> files) {
+      constexpr uint32_t iterations = 10;
+      if (files.empty()) files = {"flat_vase.obj", "smooth_vase.obj"};
+
+      for (const auto& file : files) {
+         EngineModel::convertModel(file);
+
+         size_t vertexCount = 0;
+         double objTime = measureMilliseconds(iterations, [&] {
+            EngineModel::Data data{};
+            data.loadModel(file);
+            vertexCount = data.vertices.size();
+         });
+
+         std::vector<std::byte> staging;
+         double cacheTime = measureMilliseconds(iterations, [&] {
+            auto mesh = MeshCache::load(file, sizeof(EngineModel::Vertex));
+            if (!mesh) throw Logger::Exception("mesh cache for \"{}\" could not be loaded", file);
+
+            const size_t vertexBytes = mesh->vertexCount() * sizeof(EngineModel::Vertex);
+            const size_t indexBytes = mesh->indexCount() * sizeof(uint32_t);
+            staging.resize(vertexBytes + indexBytes);
+            memcpy(staging.data(), mesh->vertexData(), vertexBytes);
+            memcpy(staging.data() + vertexBytes, mesh->indexData(), indexBytes);
+         });
+
+         logger->log("{}: {} vertices, obj {:.3f} ms, cache {:.3f} ms ({:.1f}x)", file, vertexCount, objTime, cacheTime, objTime / cacheTime);
+      }
+   }
+
+   // vertex deduplication throughput of the obj importer from 1 to hardware_concurrency threads, every
+   // result is checked vertex by vertex and index by index against the std::unordered_map importer
+   void benchmarkModelImport(std::vector<std::string> files) {
+      constexpr uint32_t iterations = 5;
+      if (files.empty()) files = {"flat_vase.obj", "smooth_vase.obj"};
+      const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+      for (const auto& file : files) {
+         EngineModel::Data reference{};
+         double referenceTime = measureMilliseconds(iterations, [&] { reference.loadModelReference(file); });
+         logger->log("{}: std::unordered_map, {:.3f} ms, {:.2f} M vertices/s", file, referenceTime, reference.indices.size() / (referenceTime / 1000.0) / 1e6);
+
+         for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+            EngineModel::Data data{};
+            double time = measureMilliseconds(iterations, [&] { data.loadModel(file, threads); });
+
+            if (data.indices != reference.indices || data.vertices != reference.vertices)
+               throw Logger::Exception("{} threads produced a different mesh for \"{}\"", threads, file);
+
+            double verticesPerSecond = data.indices.size() / (time / 1000.0);
+            logger->log("{}: {} threads, {:.3f} ms, {:.2f} M vertices/s", file, threads, time, verticesPerSecond / 1e6);
+         }
+      }
+   }
+
+   // creates and destroys thousands of meshes of random sizes through the device memory allocator, then
+   // checks that every allocation was returned and that the blocks were released
+   void benchmarkMemory(const std::vector<std::string>& args) {
+      const uint32_t operations = args.empty() ? 20000 : static_cast<uint32_t>(std::stoul(args[0]));
+
+      WindowManager windowManager{}; // initializes glfw
+      Window window{"Gears memory benchmark", 64, 64};
+      PhysicalDevice device{window};
+
+      std::mt19937 random{42};
+      std::vector<std::unique_ptr<EngineModel>> models;
+      size_t peakModels = 0;
+      MemoryAllocator::Statistics peak{};
+
+      // summed over the memory types the meshes were actually allocated from. the staging ring can share
+      // them on unified memory, what was allocated before the first mesh isn't counted
+      auto& allocator = device.allocator();
+      std::vector<MemoryAllocator::Statistics> baseline(allocator.memoryTypeCount());
+      for (uint32_t i = 0; i < allocator.memoryTypeCount(); i++) baseline[i] = allocator.getStatistics(i);
+
+      uint32_t memoryTypeBits = 0;
+      auto statistics = [&] {
+         MemoryAllocator::Statistics total{};
+         for (uint32_t i = 0; i < allocator.memoryTypeCount(); i++) {
+            if (!(memoryTypeBits & (1u << i))) continue;
+            const auto stats = allocator.getStatistics(i);
+            total.used += stats.used - baseline[i].used;
+            total.reserved += stats.reserved - baseline[i].reserved;
+            total.allocationCount += stats.allocationCount - baseline[i].allocationCount;
+            total.blockCount += stats.blockCount - baseline[i].blockCount;
+            total.fragmentation = std::max(total.fragmentation, stats.fragmentation);
+         }
+         return total;
+      };
+
+      double time = measureMilliseconds(1, [&] {
+         for (uint32_t i = 0; i < operations; i++) {
+            // slightly biased towards creation so the live set keeps growing and fragmenting
+            if (!models.empty() && random() % 100 < 45) {
+               std::swap(models[random() % models.size()], models.back());
+               models.pop_back();
+               continue;
+            }
+
+            EngineModel::Data data{};
+            data.vertices.resize(3 + random() % 4096);
+            data.indices.resize(3 * (1 + random() % 4096));
+            models.push_back(std::make_unique<EngineModel>(device, data));
+            memoryTypeBits |= models.back()->getMemoryTypeBits();
+
+            if (models.size() > peakModels) {
+               peakModels = models.size();
+               peak = statistics();
+            }
+         }
+         models.clear();
+      });
+
+      logger->log("{} operations in {:.1f} ms, peak of {} meshes", operations, time, peakModels);
+      logger->log("peak mesh memory: {} allocations in {} blocks (maxMemoryAllocationCount {}), {:.2f} / {:.2f} MiB used, {:.1f}% fragmented",
+                  peak.allocationCount, peak.blockCount, device.properties.limits.maxMemoryAllocationCount,
+                  peak.used / 1048576.0, peak.reserved / 1048576.0, peak.fragmentation * 100.f);
+      allocator.logStatistics();
+
+      // every mesh is small next to a block, so fragmentation alone can't justify more than twice the blocks
+      // the live bytes need
+      const uint64_t neededBlocks = (peak.used + MemoryAllocator::DEFAULT_BLOCK_SIZE - 1) / MemoryAllocator::DEFAULT_BLOCK_SIZE;
+      if (peak.blockCount > 2 * neededBlocks + 1) throw Logger::Exception("{} blocks for {} bytes at the peak", peak.blockCount, peak.used);
+
+      const auto remaining = statistics();
+      if (remaining.allocationCount != 0 || remaining.used != 0) throw Logger::Exception("{} allocations ({} bytes) still live after destroying every mesh", remaining.allocationCount, remaining.used);
+      // one empty block per memory type is kept for the next allocations
+      if (remaining.blockCount > static_cast<uint32_t>(std::popcount(memoryTypeBits))) throw Logger::Exception("{} blocks left after destroying every mesh", remaining.blockCount);
+   }
+
+   // vases rendered into an offscreen target by a headless device, so the benchmarks using it run
+   // without a window or a display, including on software implementations like lavapipe
+   class HeadlessScene {
+   public:
+      static constexpr VkExtent2D EXTENT{1280, 720};
+
+      HeadlessScene();
+      ~HeadlessScene();
+
+      HeadlessScene(const HeadlessScene&) = delete;
+      HeadlessScene& operator=(const HeadlessScene&) = delete;
+
+      // replaces the scene with count vases scattered uniformly inside [-halfSize, halfSize]
+      void scatter(uint32_t count, const glm::vec3& halfSize, std::mt19937& random);
+      // records into the current frame's command buffer, whose previous submission has to be complete. secondary
+      // records the draws through secondary command buffers, on the render system's job system if it has one
+      void record(bool secondary = false);
+      // submits the last recording and waits for it
+      void submit();
+      // moves on to the next frame in flight and waits for its previous submission, then records and submits
+      // without waiting, so the cpu records a frame while the gpu renders the previous one
+      void renderFrame(bool secondary = false);
+      void waitIdle();
+
+      PhysicalDevice device{};
+      OffscreenTarget target{device, EXTENT};
+      GpuProfiler gpuProfiler{device};
+      PipelineRegistry pipelines{device};
+      EngineRenderSystem renderSystem{device, pipelines, target.getRenderPass()};
+      std::shared_ptr<EngineModel> models[2];
+
+      EngineCamera camera{};
+      std::vector<EngineGameObject> objects;
+      TransformSystem transforms{};
+
+   private:
+      void _submit();
+
+      std::array<VkCommandBuffer, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> _commandBuffers;
+      std::array<VkFence, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> _fences;
+      int _frameIndex = 0;
+   };
+
+   HeadlessScene::HeadlessScene() {
+      models[0] = EngineModel::createModelFromFile(device, "flat_vase.obj");
+      models[1] = EngineModel::createModelFromFile(device, "smooth_vase.obj");
+
+      renderSystem.setGpuProfiler(&gpuProfiler);
+
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandPool = device.getCommandPool();
+      allocInfo.commandBufferCount = static_cast<uint32_t>(_commandBuffers.size());
+      if (vkAllocateCommandBuffers(device.device(), &allocInfo, _commandBuffers.data()) != VK_SUCCESS) throw Logger::Exception("failed to allocate command buffer!");
+
+      // signaled so the first wait on every frame returns right away
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+      for (auto& fence : _fences) {
+         if (vkCreateFence(device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) throw Logger::Exception("failed to create fence!");
+      }
+   }
+
+   HeadlessScene::~HeadlessScene() {
+      waitIdle();
+      for (auto fence : _fences) vkDestroyFence(device.device(), fence, nullptr);
+      vkFreeCommandBuffers(device.device(), device.getCommandPool(), static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+   }
+
+   void HeadlessScene::scatter(uint32_t count, const glm::vec3& halfSize, std::mt19937& random) {
+      std::uniform_real_distribution<float> position{-1.f, 1.f};
+      objects.clear();
+      transforms.clear();
+      objects.reserve(count);
+      for (uint32_t i = 0; i < count; i++) {
+         auto object = EngineGameObject::createGameObject();
+         object.model = models[random() % 2]; // interleaved so batching has to regroup them
+         TransformComponent transform{};
+         transform.position = glm::vec3{position(random), position(random), position(random)} * halfSize;
+         transform.scale = {3.f, 1.5f, 3.f};
+         transforms.add(object.getId(), transform);
+         objects.push_back(std::move(object));
+      }
+   }
+
+   void HeadlessScene::record(bool secondary) {
+      VkCommandBuffer commandBuffer = _commandBuffers[_frameIndex];
+      vkResetCommandBuffer(commandBuffer, 0);
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      vkBeginCommandBuffer(commandBuffer, &beginInfo);
+      gpuProfiler.beginFrame(commandBuffer, _frameIndex);
+
+      const RenderPassContext renderPass = target.getRenderPassContext();
+      const uint32_t renderPassScope = gpuProfiler.beginScope(commandBuffer, "offscreen render pass");
+      target.beginRenderPass(commandBuffer, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+      renderSystem.renderGameObjects(commandBuffer, _frameIndex, objects, transforms, camera, secondary ? &renderPass : nullptr);
+      target.endRenderPass(commandBuffer);
+      gpuProfiler.endScope(commandBuffer, renderPassScope);
+
+      gpuProfiler.endFrame(commandBuffer);
+      if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw Logger::Exception("failed to record command buffer!");
+   }
+
+   void HeadlessScene::_submit() {
+      vkResetFences(device.device(), 1, &_fences[_frameIndex]);
+
+      VkSubmitInfo submitInfo{};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &_commandBuffers[_frameIndex];
+      if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, _fences[_frameIndex]) != VK_SUCCESS) throw Logger::Exception("failed to submit command buffer!");
+   }
+
+   void HeadlessScene::submit() {
+      _submit();
+      vkWaitForFences(device.device(), 1, &_fences[_frameIndex], VK_TRUE, UINT64_MAX);
+   }
+
+   void HeadlessScene::renderFrame(bool secondary) {
+      _frameIndex = (_frameIndex + 1) % EngineSwapChain::MAX_FRAMES_IN_FLIGHT;
+      {
+         ProfileScope scope{"wait for frame"};
+         vkWaitForFences(device.device(), 1, &_fences[_frameIndex], VK_TRUE, UINT64_MAX);
+      }
+      {
+         ProfileScope scope{"record"};
+         record(secondary);
+      }
+      ProfileScope scope{"submit"};
+      _submit();
+   }
+
+   void HeadlessScene::waitIdle() {
+      vkWaitForFences(device.device(), static_cast<uint32_t>(_fences.size()), _fences.data(), VK_TRUE, UINT64_MAX);
+   }
+
+   std::vector<uint32_t> parseCounts(const std::vector<std::string>& args, std::vector<uint32_t> defaults) {
+      std::vector<uint32_t> counts;
+      for (const auto& arg : args) counts.push_back(static_cast<uint32_t>(std::stoul(arg)));
+      return counts.empty() ? defaults : counts;
+   }
+
+   // records a scene of vase instances batched into instanced indirect draws and through the push constant
+   // path every object used to take, one draw per object
+   void benchmarkInstancing(const std::vector<std::string>& args) {
+      constexpr uint32_t iterations = 20;
+
+      HeadlessScene scene{};
+      scene.renderSystem.setCulling(false); // every instance is drawn, culling has its own benchmark
+      scene.camera.setPerspectiveProjection(glm::radians(50.f), static_cast<float>(HeadlessScene::EXTENT.width) / HeadlessScene::EXTENT.height, 0.1f, 200.f);
+      scene.camera.setViewTarget({0.f, -30.f, -80.f}, {0.f, 0.f, 0.f});
+
+      for (uint32_t count : parseCounts(args, {10000, 100000})) {
+         std::mt19937 random{42};
+         scene.scatter(count, {50.f, 10.f, 50.f}, random);
+
+         double recordTime[2];
+         double frameTime[2];
+         for (bool batching : {false, true}) {
+            scene.renderSystem.setBatching(batching);
+            scene.record(); // grows the per frame buffers outside of the measurement
+            scene.submit();
+
+            recordTime[batching] = measureMilliseconds(iterations, [&] { scene.record(); });
+            frameTime[batching] = measureMilliseconds(1, [&] { scene.submit(); });
+         }
+
+         logger->log("{} instances: per object {:.3f} ms record / {:.1f} ms gpu, batched {:.3f} ms record / {:.1f} ms gpu ({:.1f}x faster to record)",
+                     count, recordTime[0], frameTime[0], recordTime[1], frameTime[1], recordTime[0] / recordTime[1]);
+      }
+   }
+
+   // large scattered scenes seen from the middle: compares testing every object against the frustum with
+   // the hierarchy (single and multithreaded, static and with moving objects) and the recording with and
+   // without culling
+   void benchmarkCulling(const std::vector<std::string>& args) {
+      constexpr uint32_t iterations = 20;
+
+      HeadlessScene scene{};
+      scene.camera.setPerspectiveProjection(glm::radians(50.f), static_cast<float>(HeadlessScene::EXTENT.width) / HeadlessScene::EXTENT.height, 0.1f, 300.f);
+      scene.camera.setViewDirection({0.f, 0.f, 0.f}, {0.f, 0.f, 1.f});
+      const glm::mat4 projectionView = scene.camera.getProjection() * scene.camera.getView();
+      const Frustum frustum = Frustum::fromMatrix(projectionView);
+      auto& culling = scene.renderSystem.cullingSystem();
+
+      JobSystem jobSystem{};
+
+      for (uint32_t count : parseCounts(args, {100000, 1000000})) {
+         std::mt19937 random{42};
+         scene.scatter(count, {500.f, 20.f, 500.f}, random);
+         scene.transforms.update();
+
+         // reference: the world bounds of every object tested against the frustum each frame
+         uint32_t bruteForceVisible = 0;
+         double bruteForceTime = measureMilliseconds(iterations, [&] {
+            bruteForceVisible = 0;
+            for (auto& object : scene.objects) {
+               const auto bounds = object.model->getBoundingBox().transformed(scene.transforms.modelMatrix(object.getId()));
+               if (frustum.test(bounds) != Frustum::Result::Outside) bruteForceVisible++;
+            }
+         });
+
+         culling.setJobSystem(nullptr);
+         double buildTime = measureMilliseconds(1, [&] { culling.cull(scene.objects, scene.transforms, projectionView); });
+         double singleTime = measureMilliseconds(iterations, [&] { culling.cull(scene.objects, scene.transforms, projectionView); });
+         const auto stats = culling.statistics();
+
+         culling.setJobSystem(&jobSystem);
+         double parallelTime = measureMilliseconds(iterations, [&] { culling.cull(scene.objects, scene.transforms, projectionView); });
+         if (culling.statistics().visible != stats.visible) throw Logger::Exception("parallel culling found {} visible objects instead of {}", culling.statistics().visible, stats.visible);
+
+         // 1% of the objects move every frame, the hierarchy gets refitted and rebuilt when it degrades
+         std::uniform_real_distribution<float> step{-1.f, 1.f};
+         uint32_t rebuilds = 0;
+         double movingTime = 0.0;
+         for (uint32_t i = 0; i < iterations; i++) {
+            for (uint32_t j = 0; j < count / 100; j++) {
+               const auto id = scene.objects[random() % count].getId();
+               scene.transforms.setPosition(id, scene.transforms.get(id).position + glm::vec3{step(random), 0.f, step(random)});
+            }
+            scene.transforms.update();
+            movingTime += measureMilliseconds(1, [&] { culling.cull(scene.objects, scene.transforms, projectionView); });
+            rebuilds += culling.statistics().rebuilt;
+         }
+         movingTime /= iterations;
+
+         logger->log("{} objects, {} visible ({} with brute force), {} nodes tested", count, stats.visible, bruteForceVisible, stats.nodesTested);
+         logger->log("   brute force {:.3f} ms, build {:.3f} ms, hierarchy {:.3f} ms, {} threads {:.3f} ms, 1% moving {:.3f} ms ({} rebuilds)",
+                     bruteForceTime, buildTime, singleTime, jobSystem.threadCount(), parallelTime, movingTime, rebuilds);
+
+         double recordTime[2];
+         double frameTime[2];
+         for (bool enabled : {false, true}) {
+            scene.renderSystem.setCulling(enabled);
+            scene.record();
+            scene.submit();
+
+            recordTime[enabled] = measureMilliseconds(iterations, [&] { scene.record(); });
+            frameTime[enabled] = measureMilliseconds(1, [&] { scene.submit(); });
+         }
+         logger->log("   record {:.3f} ms / gpu {:.1f} ms without culling, record {:.3f} ms / gpu {:.1f} ms with culling",
+                     recordTime[0], frameTime[0], recordTime[1], frameTime[1]);
+      }
+      culling.setJobSystem(nullptr);
+   }
+
+   // cpu time of recording every object of a scene into secondary command buffers on 1 to N threads, with
+   // one draw per object and with batched indirect draws, against recording inline on the calling thread.
+   // both scatter two models, so batching has to split its batches across the secondaries to use the threads
+   void benchmarkRecording(const std::vector<std::string>& args) {
+      constexpr uint32_t iterations = 20;
+
+      HeadlessScene scene{};
+      scene.renderSystem.setCulling(false); // the same draws for every thread count
+      scene.camera.setPerspectiveProjection(glm::radians(50.f), static_cast<float>(HeadlessScene::EXTENT.width) / HeadlessScene::EXTENT.height, 0.1f, 200.f);
+      scene.camera.setViewTarget({0.f, -30.f, -80.f}, {0.f, 0.f, 0.f});
+
+      const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<uint32_t> threadCounts;
+      for (uint32_t threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+      threadCounts.push_back(maxThreads);
+
+      for (uint32_t count : parseCounts(args, {100000})) {
+         std::mt19937 random{42};
+         scene.scatter(count, {50.f, 10.f, 50.f}, random);
+
+         for (bool batching : {false, true}) {
+            scene.renderSystem.setBatching(batching);
+            scene.renderSystem.setJobSystem(nullptr);
+            scene.record(); // grows the per frame buffers outside of the measurement
+            scene.submit();
+            double inlineTime = measureMilliseconds(iterations, [&] { scene.record(); });
+            logger->log("{} objects {}: inline {:.3f} ms", count, batching ? "batched" : "per object", inlineTime);
+
+            double singleThreadTime = 0.0;
+            double bestTime = inlineTime;
+            uint32_t bestThreads = 0;
+            for (uint32_t threads : threadCounts) {
+               JobSystem jobSystem{threads};
+               scene.renderSystem.setJobSystem(&jobSystem);
+               scene.record(true); // allocates the secondary command buffers
+               scene.submit();
+
+               double recordTime = measureMilliseconds(iterations, [&] { scene.record(true); });
+               if (threads == 1) singleThreadTime = recordTime;
+               if (recordTime < bestTime) {
+                  bestTime = recordTime;
+                  bestThreads = threads;
+               }
+               logger->log("   {} threads: {:.3f} ms ({:.2f}x)", threads, recordTime, singleThreadTime / recordTime);
+               scene.renderSystem.setJobSystem(nullptr);
+            }
+            if (bestThreads) logger->log("   best: {} threads, {:.2f}x faster than inline", bestThreads, inlineTime / bestTime);
+            else
+               logger->log("   no thread count beat recording inline");
+         }
+      }
+   }
+
+   // startup with an empty pipeline cache and with the one the previous run saved: device creation, loading
+   // the cache, creating the render system's pipelines, creating a second render system, whose own pipeline
+   // layouts need their own pipelines but share the shader modules and the in memory cache, and saving the cache
+   void benchmarkPipelines(const std::vector<std::string>& args) {
+      const uint32_t runs = args.size() > 0 ? static_cast<uint32_t>(std::stoul(args[0])) : 3;
+      const std::string cachePath = "benchmark_pipelines.grscache"; // keeps the engine's own cache untouched
+
+      for (uint32_t run = 0; run < runs; run++) {
+         std::filesystem::remove(cachePath);
+
+         for (bool warm : {false, true}) {
+            auto start = std::chrono::high_resolution_clock::now();
+            auto device = std::make_unique<PhysicalDevice>();
+            auto deviceCreated = std::chrono::high_resolution_clock::now();
+            OffscreenTarget target{*device, HeadlessScene::EXTENT};
+
+            auto registry = std::make_unique<PipelineRegistry>(*device, cachePath);
+            if (registry->pipelineCache().isWarm() != warm) throw Logger::Exception("pipeline cache is {} on the {} start", warm ? "cold" : "warm", warm ? "warm" : "cold");
+            auto cacheLoaded = std::chrono::high_resolution_clock::now();
+
+            std::unique_ptr<EngineRenderSystem> renderSystem;
+            double createTime = measureMilliseconds(1, [&] { renderSystem = std::make_unique<EngineRenderSystem>(*device, *registry, target.getRenderPass()); });
+            std::unique_ptr<EngineRenderSystem> secondRenderSystem;
+            double secondTime = measureMilliseconds(1, [&] { secondRenderSystem = std::make_unique<EngineRenderSystem>(*device, *registry, target.getRenderPass()); });
+            // the instanced pipeline and the push constant reference one per render system, from three shader files
+            if (registry->size() != 4) throw Logger::Exception("the registry holds {} pipelines instead of 4", registry->size());
+            if (registry->shaderModules().size() != 3) throw Logger::Exception("the registry holds {} shader modules instead of 3", registry->shaderModules().size());
+            auto end = std::chrono::high_resolution_clock::now();
+
+            // destroying its pipeline layouts has to drop its pipelines from the registry
+            secondRenderSystem.reset();
+            if (registry->size() != 2) throw Logger::Exception("the registry holds {} pipelines after releasing a render system instead of 2", registry->size());
+            renderSystem.reset();
+            double saveTime = measureMilliseconds(1, [&] { registry.reset(); });
+
+            logger->log("{} start: device {:.1f} ms, cache load {:.2f} ms, render system {:.2f} ms, second render system {:.2f} ms, total {:.1f} ms, save {:.2f} ms",
+                        warm ? "warm" : "cold",
+                        std::chrono::duration<double, std::milli>(deviceCreated - start).count(),
+                        std::chrono::duration<double, std::milli>(cacheLoaded - deviceCreated).count(),
+                        createTime, secondTime,
+                        std::chrono::duration<double, std::milli>(end - start).count(),
+                        saveTime);
+         }
+      }
+      std::filesystem::remove(cachePath);
+   }
+
+   // updates the model and normal matrices of a million transforms with every kernel, once with all of
+   // them dirty and once with only a few, and checks the results against TransformComponent
+   void benchmarkTransforms(const std::vector<std::string>& args) {
+      constexpr uint32_t iterations = 10;
+      const uint32_t count = args.size() > 0 ? static_cast<uint32_t>(std::stoul(args[0])) : 1000000;
+      const uint32_t fewDirty = args.size() > 1 ? static_cast<uint32_t>(std::stoul(args[1])) : count / 100;
+
+      std::mt19937 random{42};
+      std::uniform_real_distribution<float> position{-100.f, 100.f};
+      std::uniform_real_distribution<float> angle{-glm::pi<float>(), glm::pi<float>()};
+      std::uniform_real_distribution<float> scale{.1f, 4.f};
+
+      std::vector<TransformComponent> components(count);
+      for (auto& component : components) {
+         component.position = {position(random), position(random), position(random)};
+         component.rotation = glm::quat{1.f, angle(random), angle(random), angle(random)};
+         component.scale = {scale(random), scale(random), scale(random)};
+      }
+
+      // reference: the array of structs path every object used to go through each frame
+      std::vector<glm::mat4> modelMatrices(count);
+      std::vector<glm::mat4> normalMatrices(count);
+      double referenceTime = measureMilliseconds(iterations, [&] {
+         for (uint32_t i = 0; i < count; i++) {
+            modelMatrices[i] = components[i].mat4();
+            normalMatrices[i] = glm::mat4{components[i].normalMatrix()};
+         }
+      });
+      logger->log("{} transforms, TransformComponent: {:.2f} ms", count, referenceTime);
+
+      TransformSystem transforms{};
+      for (uint32_t i = 0; i < count; i++) transforms.add(i, components[i]);
+
+      const std::pair<TransformSystem::Kernel, const char*> kernels[] = {
+          {TransformSystem::Kernel::Scalar, "scalar"},
+          {TransformSystem::Kernel::SSE, "sse"},
+          {TransformSystem::Kernel::AVX2, "avx2"}};
+
+      for (auto [kernel, kernelName] : kernels) {
+         if (!TransformSystem::isSupported(kernel)) {
+            logger->log("{}: not supported on this cpu", kernelName);
+            continue;
+         }
+         transforms.setKernel(kernel);
+
+         auto markDirty = [&](uint32_t dirtyCount) {
+            for (uint32_t i = 0; i < dirtyCount; i++) {
+               const uint32_t id = dirtyCount == count ? i : static_cast<uint32_t>(random() % count);
+               transforms.setPosition(id, components[id].position);
+            }
+         };
+
+         // the marking isn't part of the measurement, every iteration is timed on its own
+         auto measureUpdate = [&](uint32_t dirtyCount) {
+            double total = 0.0;
+            for (uint32_t i = 0; i < iterations; i++) {
+               markDirty(dirtyCount);
+               total += measureMilliseconds(1, [&] { transforms.update(); });
+            }
+            return total / iterations;
+         };
+
+         double allDirtyTime = measureUpdate(count);
+
+         float maxError = 0.f;
+         for (uint32_t i = 0; i < count; i++) {
+            for (int column = 0; column < 4; column++) {
+               for (int row = 0; row < 4; row++) {
+                  maxError = std::max(maxError, std::abs(transforms.modelMatrix(i)[column][row] - modelMatrices[i][column][row]));
+                  maxError = std::max(maxError, std::abs(transforms.normalMatrix(i)[column][row] - normalMatrices[i][column][row]));
+               }
+            }
+         }
+         // matrix entries are bounded by scale and position, so this is well above rounding noise
+         if (maxError > 1e-3f) throw Logger::Exception("{} kernel differs from TransformComponent by {}", kernelName, maxError);
+
+         double fewDirtyTime = measureUpdate(fewDirty);
+         double cleanTime = measureUpdate(0);
+
+         logger->log("{}: all dirty {:.2f} ms ({:.1f}x), {} dirty {:.3f} ms, clean {:.3f} ms, max error {:.2e}",
+                     kernelName, allDirtyTime, referenceTime / allDirtyTime, fewDirty, fewDirtyTime, cleanTime, maxError);
+      }
+   }
+
+   void runHeadless(const std::vector<std::string>& args) {
+      const uint32_t frames = args.size() > 0 ? static_cast<uint32_t>(std::stoul(args[0])) : 1000;
+      const uint32_t count = args.size() > 1 ? static_cast<uint32_t>(std::stoul(args[1])) : 10000;
+      const std::string tracePath = args.size() > 2 ? args[2] : "profile.json";
+      if (!profiler) throw Logger::Exception("headless runs need a profiler");
+
+      HeadlessScene scene{};
+      JobSystem jobSystem{};
+      scene.renderSystem.setJobSystem(&jobSystem);
+      scene.camera.setPerspectiveProjection(glm::radians(50.f), static_cast<float>(HeadlessScene::EXTENT.width) / HeadlessScene::EXTENT.height, 0.1f, 300.f);
+
+      std::mt19937 random{42};
+      scene.scatter(count, {100.f, 10.f, 100.f}, random);
+      std::uniform_real_distribution<float> step{-.1f, .1f};
+
+      logger->log("rendering {} frames of {} objects at {}x{} on {}", frames, count, HeadlessScene::EXTENT.width, HeadlessScene::EXTENT.height, scene.device.properties.deviceName);
+      profiler->setEnabled(true);
+      for (uint32_t frame = 0; frame < frames; frame++) {
+         profiler->beginFrame();
+         {
+            // orbiting camera and 1% of the objects moving, so culling and the transforms have work every frame
+            ProfileScope scope{"update scene"};
+            const float angle = static_cast<float>(frame) * .01f;
+            scene.camera.setViewTarget({std::sin(angle) * 120.f, -30.f, std::cos(angle) * 120.f}, {0.f, 0.f, 0.f});
+            for (uint32_t i = 0; i < count / 100; i++) {
+               const auto id = scene.objects[random() % count].getId();
+               scene.transforms.setPosition(id, scene.transforms.get(id).position + glm::vec3{step(random), 0.f, step(random)});
+            }
+         }
+         scene.renderFrame(true);
+         profiler->endFrame();
+      }
+      scene.waitIdle();
+      scene.gpuProfiler.readPendingResults();
+      profiler->setEnabled(false);
+
+      const auto& culling = scene.renderSystem.cullingSystem().statistics();
+      logger->log("last frame: {} objects visible, {} culled", culling.visible, culling.culled);
+      profiler->logStatistics();
+      profiler->exportChromeTrace(tracePath);
+      scene.renderSystem.setJobSystem(nullptr);
+   }
+
+   void runBenchmark(const std::vector<std::string>& args) {
+      if (args.empty()) throw Logger::Exception("no benchmark specified, available benchmarks: mesh, import, memory, instancing, transforms, culling, recording, pipelines");
+
+      const std::string& name = args[0];
+      std::vector<std::string> benchmarkArgs(args.begin() + 1, args.end());
+
+      if (name == "mesh") benchmarkMeshLoading(benchmarkArgs);
+      else if (name == "import") benchmarkModelImport(benchmarkArgs);
+      else if (name == "memory") benchmarkMemory(benchmarkArgs);
+      else if (name == "instancing") benchmarkInstancing(benchmarkArgs);
+      else if (name == "transforms") benchmarkTransforms(benchmarkArgs);
+      else if (name == "culling") benchmarkCulling(benchmarkArgs);
+      else if (name == "recording") benchmarkRecording(benchmarkArgs);
+      else if (name == "pipelines") benchmarkPipelines(benchmarkArgs);
+      else
+         throw Logger::Exception("unknown benchmark \"{}\"", name);
+   }
+} // namespace gears
@@ -0,0 +1,173 @@
+module;
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRS_BOUNDS_SSE
+#include <immintrin.h>
+#endif // SSE2
+
+export module engine.bounds;
+
+namespace gears {
+
+   export struct BoundingBox {
+      glm::vec3 min{std::numeric_limits<float>::max()};
+      glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+      bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+      glm::vec3 center() const { return (min + max) * .5f; }
+      glm::vec3 extent() const { return (max - min) * .5f; }
+      float surfaceArea() const;
+
+      void expand(const glm::vec3& point);
+      void expand(const BoundingBox& other);
+      BoundingBox intersection(const BoundingBox& other) const { return {glm::max(min, other.min), glm::min(max, other.max)}; }
+
+      // box enclosing this one after the transformation
+      BoundingBox transformed(const glm::mat4& transform) const;
+   };
+
+   export struct BoundingSphere {
+      glm::vec3 center{};
+      float radius = 0.f;
+
+      // sphere enclosing this one after the transformation, non uniform scales use the largest axis
+      BoundingSphere transformed(const glm::mat4& transform) const;
+      BoundingBox box() const { return {center - radius, center + radius}; }
+   };
+
+   // the 6 planes of a view frustum, normals point inwards
+   export class Frustum {
+   public:
+      enum class Result {
+         Outside,
+         Intersecting,
+         Inside,
+      };
+
+      // planes of projection * view, for a [0, 1] depth range
+      static Frustum fromMatrix(const glm::mat4& projectionView);
+
+      Result test(const BoundingBox& box) const;
+
+   private:
+      // structure of arrays, padded to 8 planes with ones that contain everything so they can be
+      // tested two 4 wide vectors at a time
+      alignas(16) float _normalX[8];
+      alignas(16) float _normalY[8];
+      alignas(16) float _normalZ[8];
+      alignas(16) float _distance[8];
+   };
+
+   // ========================================== implementation ==========================================
+
+   float BoundingBox::surfaceArea() const {
+      if (!isValid()) return 0.f;
+      const glm::vec3 size = max - min;
+      return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+   }
+
+   void BoundingBox::expand(const glm::vec3& point) {
+      min = glm::min(min, point);
+      max = glm::max(max, point);
+   }
+
+   void BoundingBox::expand(const BoundingBox& other) {
+      min = glm::min(min, other.min);
+      max = glm::max(max, other.max);
+   }
+
+   BoundingBox BoundingBox::transformed(const glm::mat4& transform) const {
+      const glm::vec3 newCenter = glm::vec3{transform * glm::vec4{center(), 1.f}};
+      const glm::vec3 oldExtent = extent();
+      const glm::vec3 newExtent = glm::abs(glm::vec3{transform[0]}) * oldExtent.x +
+                                  glm::abs(glm::vec3{transform[1]}) * oldExtent.y +
+                                  glm::abs(glm::vec3{transform[2]}) * oldExtent.z;
+      return {newCenter - newExtent, newCenter + newExtent};
+   }
+
+   BoundingSphere BoundingSphere::transformed(const glm::mat4& transform) const {
+      const float scale = std::sqrt(std::max({
+          glm::dot(glm::vec3{transform[0]}, glm::vec3{transform[0]}),
+          glm::dot(glm::vec3{transform[1]}, glm::vec3{transform[1]}),
+          glm::dot(glm::vec3{transform[2]}, glm::vec3{transform[2]}),
+      }));
+      return {glm::vec3{transform * glm::vec4{center, 1.f}}, radius * scale};
+   }
+
+   Frustum Frustum::fromMatrix(const glm::mat4& projectionView) {
+      // Gribb-Hartmann, glm is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+      auto row = [&](int i) { return glm::vec4{projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]}; };
+      const glm::vec4 planes[6] = {
+          row(3) + row(0), // left
+          row(3) - row(0), // right
+          row(3) + row(1), // bottom
+          row(3) - row(1), // top
+          row(2),          // near
+          row(3) - row(2), // far
+      };
+
+      Frustum frustum;
+      for (int i = 0; i < 8; i++) {
+         if (i >= 6) {
+            frustum._normalX[i] = frustum._normalY[i] = frustum._normalZ[i] = 0.f;
+            frustum._distance[i] = std::numeric_limits<float>::max();
+            continue;
+         }
+         const float length = glm::length(glm::vec3{planes[i]});
+         frustum._normalX[i] = planes[i].x / length;
+         frustum._normalY[i] = planes[i].y / length;
+         frustum._normalZ[i] = planes[i].z / length;
+         frustum._distance[i] = planes[i].w / length;
+      }
+      return frustum;
+   }
+
+   Frustum::Result Frustum::test(const BoundingBox& box) const {
+      const glm::vec3 center = box.center();
+      const glm::vec3 extent = box.extent();
+
+#if defined(GRS_BOUNDS_SSE)
+      const __m128 centerX = _mm_set1_ps(center.x), centerY = _mm_set1_ps(center.y), centerZ = _mm_set1_ps(center.z);
+      const __m128 extentX = _mm_set1_ps(extent.x), extentY = _mm_set1_ps(extent.y), extentZ = _mm_set1_ps(extent.z);
+      const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+      int outside = 0;
+      int intersecting = 0;
+      for (int i = 0; i < 8; i += 4) {
+         const __m128 normalX = _mm_load_ps(&_normalX[i]);
+         const __m128 normalY = _mm_load_ps(&_normalY[i]);
+         const __m128 normalZ = _mm_load_ps(&_normalZ[i]);
+
+         // signed distance of the center and the box extent projected on the plane normal
+         const __m128 distance = _mm_add_ps(
+             _mm_add_ps(_mm_mul_ps(normalX, centerX), _mm_mul_ps(normalY, centerY)),
+             _mm_add_ps(_mm_mul_ps(normalZ, centerZ), _mm_load_ps(&_distance[i])));
+         const __m128 radius = _mm_add_ps(
+             _mm_add_ps(_mm_mul_ps(_mm_and_ps(normalX, absMask), extentX), _mm_mul_ps(_mm_and_ps(normalY, absMask), extentY)),
+             _mm_mul_ps(_mm_and_ps(normalZ, absMask), extentZ));
+
+         outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+         intersecting |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+      }
+      if (outside) return Result::Outside;
+      return intersecting ? Result::Intersecting : Result::Inside;
+#else
+      Result result = Result::Inside;
+      for (int i = 0; i < 6; i++) {
+         const float distance = _normalX[i] * center.x + _normalY[i] * center.y + _normalZ[i] * center.z + _distance[i];
+         const float radius = std::abs(_normalX[i]) * extent.x + std::abs(_normalY[i]) * extent.y + std::abs(_normalZ[i]) * extent.z;
+         if (distance + radius < 0.f) return Result::Outside;
+         if (distance - radius < 0.f) result = Result::Intersecting;
+      }
+      return result;
+#endif // defined(GRS_BOUNDS_SSE)
+   }
+} // namespace gears
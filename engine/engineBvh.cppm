@@ -0,0 +1,234 @@
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+export module engine.bvh;
+import engine.bounds;
+
+namespace gears {
+
+   // bounding volume hierarchy over a set of boxes, identified by their index in the vector passed to build().
+   // boxes that move are refitted in place, the owner rebuilds the tree once refit() reports that it degraded
+   export class BoundingVolumeHierarchy {
+   public:
+      static constexpr uint32_t MAX_LEAF_SIZE = 4;
+      // refitted trees get rebuilt once their total node area grows past this factor of the built one
+      static constexpr float MAX_DEGRADATION = 1.5f;
+
+      // every subtree covers a contiguous range of items(), so fully visible subtrees are a single copy
+      struct Node {
+         BoundingBox bounds{};
+         uint32_t first = 0; // first of the subtree's items
+         uint32_t count = 0; // number of items in the subtree
+         uint32_t left = 0;  // the right child is left + 1, 0 for leaves
+         uint32_t parent = 0;
+
+         bool isLeaf() const { return left == 0; }
+      };
+
+      void build(std::vector<BoundingBox> bounds);
+      void clear();
+
+      size_t size() const { return _bounds.size(); }
+      const BoundingBox& bounds(uint32_t item) const { return _bounds[item]; }
+      const std::vector<Node>& nodes() const { return _nodes; }
+
+      // the nodes above item are refitted by the next refit()
+      void update(uint32_t item, const BoundingBox& bounds);
+      // returns false when the tree has degraded enough that it should be rebuilt
+      bool refit();
+
+      // appends the items in node's subtree that intersect the frustum, returns the number of nodes tested
+      uint32_t query(const Frustum& frustum, std::vector<uint32_t>& visible, uint32_t node = 0) const;
+      // splits the tree into at least count disjoint subtrees (unless it has fewer leaves) to query them in parallel
+      void splitSubtrees(uint32_t count, std::vector<uint32_t>& subtrees) const;
+
+   private:
+      void _refitNode(uint32_t node);
+
+      std::vector<BoundingBox> _bounds;
+      std::vector<uint32_t> _items; // item indices ordered so that every node covers a contiguous range
+      std::vector<uint32_t> _itemLeaves;
+      std::vector<Node> _nodes;
+
+      std::vector<uint8_t> _nodeChanged;
+      std::vector<uint32_t> _changedNodes;
+
+      float _builtArea = 0.f;
+      float _area = 0.f; // sum of the area of every node, measures how loose the tree is
+   };
+
+   // ========================================== implementation ==========================================
+
+   void BoundingVolumeHierarchy::clear() {
+      _bounds.clear();
+      _items.clear();
+      _itemLeaves.clear();
+      _nodes.clear();
+      _nodeChanged.clear();
+      _changedNodes.clear();
+      _builtArea = _area = 0.f;
+   }
+
+   void BoundingVolumeHierarchy::build(std::vector<BoundingBox> bounds) {
+      clear();
+      _bounds = std::move(bounds);
+      if (_bounds.empty()) return;
+
+      const uint32_t itemCount = static_cast<uint32_t>(_bounds.size());
+      _items.resize(itemCount);
+      for (uint32_t i = 0; i < itemCount; i++) _items[i] = i;
+      _itemLeaves.resize(itemCount);
+      _nodes.reserve(2 * (itemCount / MAX_LEAF_SIZE + 1));
+
+      _nodes.push_back({{}, 0, itemCount, 0, 0});
+      std::vector<uint32_t> stack{0};
+      while (!stack.empty()) {
+         const uint32_t nodeIndex = stack.back();
+         stack.pop_back();
+
+         // _nodes may reallocate below, so the node is read through its index
+         const uint32_t first = _nodes[nodeIndex].first;
+         const uint32_t count = _nodes[nodeIndex].count;
+
+         BoundingBox bounds{};
+         BoundingBox centers{};
+         for (uint32_t i = first; i < first + count; i++) {
+            bounds.expand(_bounds[_items[i]]);
+            centers.expand(_bounds[_items[i]].center());
+         }
+         _nodes[nodeIndex].bounds = bounds;
+
+         if (count <= MAX_LEAF_SIZE) {
+            for (uint32_t i = first; i < first + count; i++) _itemLeaves[_items[i]] = nodeIndex;
+            continue;
+         }
+
+         // median split along the axis where the centers are the most spread out
+         const glm::vec3 spread = centers.max - centers.min;
+         const int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+         const uint32_t half = count / 2;
+         std::nth_element(_items.begin() + first, _items.begin() + first + half, _items.begin() + first + count, [&](uint32_t a, uint32_t b) {
+            return _bounds[a].center()[axis] < _bounds[b].center()[axis];
+         });
+
+         const uint32_t left = static_cast<uint32_t>(_nodes.size());
+         _nodes[nodeIndex].left = left;
+         _nodes.push_back({{}, first, half, 0, nodeIndex});
+         _nodes.push_back({{}, first + half, count - half, 0, nodeIndex});
+         stack.push_back(left);
+         stack.push_back(left + 1);
+      }
+
+      _nodeChanged.assign(_nodes.size(), 0);
+      for (const auto& node : _nodes) _area += node.bounds.surfaceArea();
+      _builtArea = _area;
+   }
+
+   void BoundingVolumeHierarchy::update(uint32_t item, const BoundingBox& bounds) {
+      _bounds[item] = bounds;
+
+      const uint32_t leaf = _itemLeaves[item];
+      if (_nodeChanged[leaf]) return;
+      _nodeChanged[leaf] = 1;
+      _changedNodes.push_back(leaf);
+   }
+
+   bool BoundingVolumeHierarchy::refit() {
+      if (_changedNodes.empty()) return _area <= _builtArea * MAX_DEGRADATION;
+
+      // every ancestor of a changed leaf needs refitting too, shared ancestors are only added once
+      for (size_t i = 0; i < _changedNodes.size(); i++) {
+         const uint32_t node = _changedNodes[i];
+         if (node == 0) continue;
+         const uint32_t parent = _nodes[node].parent;
+         if (_nodeChanged[parent]) continue;
+         _nodeChanged[parent] = 1;
+         _changedNodes.push_back(parent);
+      }
+
+      // children are always created after their parent, refitting in decreasing index order goes bottom up
+      std::sort(_changedNodes.begin(), _changedNodes.end(), std::greater<uint32_t>{});
+      for (uint32_t node : _changedNodes) {
+         _refitNode(node);
+         _nodeChanged[node] = 0;
+      }
+      _changedNodes.clear();
+
+      return _area <= _builtArea * MAX_DEGRADATION;
+   }
+
+   void BoundingVolumeHierarchy::_refitNode(uint32_t nodeIndex) {
+      Node& node = _nodes[nodeIndex];
+      BoundingBox bounds{};
+      if (node.isLeaf()) {
+         for (uint32_t i = node.first; i < node.first + node.count; i++) bounds.expand(_bounds[_items[i]]);
+      } else {
+         bounds.expand(_nodes[node.left].bounds);
+         bounds.expand(_nodes[node.left + 1].bounds);
+      }
+
+      _area += bounds.surfaceArea() - node.bounds.surfaceArea();
+      node.bounds = bounds;
+   }
+
+   uint32_t BoundingVolumeHierarchy::query(const Frustum& frustum, std::vector<uint32_t>& visible, uint32_t node) const {
+      if (_nodes.empty()) return 0;
+
+      uint32_t nodesTested = 0;
+      uint32_t stack[64]; // median splits keep the depth around log2(items / MAX_LEAF_SIZE)
+      uint32_t stackSize = 0;
+      stack[stackSize++] = node;
+
+      while (stackSize > 0) {
+         const Node& current = _nodes[stack[--stackSize]];
+         if (!current.bounds.isValid()) continue;
+
+         nodesTested++;
+         const auto result = frustum.test(current.bounds);
+         if (result == Frustum::Result::Outside) continue;
+
+         if (result == Frustum::Result::Inside) {
+            for (uint32_t i = current.first; i < current.first + current.count; i++) {
+               if (_bounds[_items[i]].isValid()) visible.push_back(_items[i]);
+            }
+         } else if (current.isLeaf()) {
+            for (uint32_t i = current.first; i < current.first + current.count; i++) {
+               const auto& bounds = _bounds[_items[i]];
+               if (bounds.isValid() && frustum.test(bounds) != Frustum::Result::Outside) visible.push_back(_items[i]);
+            }
+         } else {
+            stack[stackSize++] = current.left + 1;
+            stack[stackSize++] = current.left;
+         }
+      }
+      return nodesTested;
+   }
+
+   void BoundingVolumeHierarchy::splitSubtrees(uint32_t count, std::vector<uint32_t>& subtrees) const {
+      subtrees.clear();
+      if (_nodes.empty()) return;
+      subtrees.push_back(0);
+
+      // keeps splitting the subtree with the most items so the tasks end up with similar amounts of work
+      while (subtrees.size() < count) {
+         auto largest = subtrees.end();
+         for (auto it = subtrees.begin(); it != subtrees.end(); it++) {
+            if (!_nodes[*it].isLeaf() && (largest == subtrees.end() || _nodes[*it].count > _nodes[*largest].count)) largest = it;
+         }
+         if (largest == subtrees.end()) return;
+
+         const uint32_t left = _nodes[*largest].left;
+         *largest = left;
+         subtrees.push_back(left + 1);
+      }
+   }
+} // namespace gears
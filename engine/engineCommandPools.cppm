@@ -0,0 +1,128 @@
+module;
+
+#include <array>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "macro.hpp"
+
+export module engine.commandPools;
+import engine.device;
+import engine.logger;
+import engine.swapChain;
+
+namespace gears {
+
+   // what a secondary command buffer needs to continue a render pass begun on a primary one
+   export struct RenderPassContext {
+      VkRenderPass renderPass;
+      VkFramebuffer framebuffer; // can be VK_NULL_HANDLE, but drivers may record faster when they know it
+      VkExtent2D extent;
+   };
+
+   // one command pool per frame in flight and per recording thread. command buffers are never freed one by
+   // one, the whole pool is reset once the frame that used it has finished on the gpu and its buffers are reused
+   export class FrameCommandPools {
+   public:
+      FrameCommandPools(PhysicalDevice& device, uint32_t threadCount);
+      ~FrameCommandPools();
+
+      FrameCommandPools(const FrameCommandPools&) = delete;
+      FrameCommandPools& operator=(const FrameCommandPools&) = delete;
+
+      uint32_t threadCount() const { return _threadCount; }
+
+      // resets every pool of frameIndex, the previous submission of that frame has to be complete
+      void reset(int frameIndex);
+
+      // secondary command buffer from threadIndex's pool, already begun inside context's render pass with
+      // the viewport and scissor set. only threadIndex may record into it until the frame is reset
+      VkCommandBuffer beginSecondary(int frameIndex, uint32_t threadIndex, const RenderPassContext& context);
+
+   private:
+      struct ThreadPools {
+         VkCommandPool pool = VK_NULL_HANDLE;
+         std::vector<VkCommandBuffer> secondaryBuffers; // allocated on demand, kept across resets
+         uint32_t usedSecondaryBuffers = 0;
+      };
+
+      PhysicalDevice& _device;
+      uint32_t _threadCount;
+      std::array<std::vector<ThreadPools>, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> _frames;
+   };
+
+   //  ========================================== implementation ==========================================
+
+   FrameCommandPools::FrameCommandPools(PhysicalDevice& device, uint32_t threadCount) : _device{device}, _threadCount{threadCount} {
+      VkCommandPoolCreateInfo poolInfo = {};
+      poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.queueFamilyIndex = _device.findPhysicalQueueFamilies().graphicsFamily;
+      poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+      for (auto& frame : _frames) {
+         frame.resize(_threadCount);
+         for (auto& thread : frame) {
+            if (vkCreateCommandPool(_device.device(), &poolInfo, nullptr, &thread.pool) != VK_SUCCESS) throw Logger::Exception("failed to create command pool!");
+         }
+      }
+   }
+
+   FrameCommandPools::~FrameCommandPools() {
+      // destroying a pool frees its command buffers
+      for (auto& frame : _frames) {
+         for (auto& thread : frame) vkDestroyCommandPool(_device.device(), thread.pool, nullptr);
+      }
+   }
+
+   void FrameCommandPools::reset(int frameIndex) {
+      for (auto& thread : _frames[frameIndex]) {
+         vkResetCommandPool(_device.device(), thread.pool, 0);
+         thread.usedSecondaryBuffers = 0;
+      }
+   }
+
+   VkCommandBuffer FrameCommandPools::beginSecondary(int frameIndex, uint32_t threadIndex, const RenderPassContext& context) {
+      GRS_LOG_ASSERT(threadIndex < _threadCount, "thread index {} out of range, the pools were created for {} threads", threadIndex, _threadCount);
+      auto& thread = _frames[frameIndex][threadIndex];
+
+      if (thread.usedSecondaryBuffers == thread.secondaryBuffers.size()) {
+         VkCommandBufferAllocateInfo allocInfo{};
+         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+         allocInfo.commandPool = thread.pool;
+         allocInfo.commandBufferCount = 1;
+
+         VkCommandBuffer commandBuffer;
+         if (vkAllocateCommandBuffers(_device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) throw Logger::Exception("failed to allocate secondary command buffer");
+         thread.secondaryBuffers.push_back(commandBuffer);
+      }
+      VkCommandBuffer commandBuffer = thread.secondaryBuffers[thread.usedSecondaryBuffers++];
+
+      VkCommandBufferInheritanceInfo inheritanceInfo{};
+      inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritanceInfo.renderPass = context.renderPass;
+      inheritanceInfo.subpass = 0;
+      inheritanceInfo.framebuffer = context.framebuffer;
+
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      beginInfo.pInheritanceInfo = &inheritanceInfo;
+      if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw Logger::Exception("failed to begin recording secondary command buffer");
+
+      // dynamic state isn't inherited from the primary command buffer
+      VkViewport viewport{};
+      viewport.x = 0.0f;
+      viewport.y = 0.0f;
+      viewport.width = static_cast<float>(context.extent.width);
+      viewport.height = static_cast<float>(context.extent.height);
+      viewport.minDepth = 0.0f;
+      viewport.maxDepth = 1.0f;
+      VkRect2D scissor{{0, 0}, context.extent};
+      vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+      return commandBuffer;
+   }
+} // namespace gears
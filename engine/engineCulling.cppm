@@ -0,0 +1,173 @@
+module;
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+export module engine.culling;
+import engine.bounds;
+import engine.bvh;
+import engine.gameObject;
+import engine.jobSystem;
+import engine.profiler;
+import engine.transformSystem;
+import engineModel;
+
+namespace gears {
+
+   // frustum culling of game objects through a bounding volume hierarchy over their world space bounds.
+   // the hierarchy is refitted for objects whose transform or model changed and rebuilt when objects
+   // are added or removed or when the refits made it too loose
+   export class CullingSystem {
+   public:
+      // scenes smaller than this are always culled on the calling thread
+      static constexpr uint32_t PARALLEL_THRESHOLD = 16384;
+
+      struct Statistics {
+         uint32_t visible = 0;
+         uint32_t culled = 0;  // outside the frustum
+         uint32_t skipped = 0; // without a model or a transform, never tested
+         uint32_t nodesTested = 0;
+         uint32_t boundsUpdated = 0;
+         bool rebuilt = false;
+         float milliseconds = 0.f;
+      };
+
+      CullingSystem() = default;
+
+      CullingSystem(const CullingSystem&) = delete;
+      CullingSystem& operator=(const CullingSystem&) = delete;
+
+      // optional, large scenes get culled on the job system a few subtrees per thread
+      void setJobSystem(JobSystem* jobSystem) { _jobSystem = jobSystem; }
+
+      // returns the indices in gameObjects of the objects inside the frustum of projectionView, the matrices in
+      // transforms have to be up to date. objects without a model or without an entry in transforms are never visible
+      const std::vector<uint32_t>& cull(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const glm::mat4& projectionView);
+
+      const Statistics& statistics() const { return _statistics; }
+
+   private:
+      struct Entry {
+         EngineGameObject::id_t id;
+         const EngineModel* model;
+         uint64_t revision;
+      };
+
+      static BoundingBox _worldBounds(const EngineModel* model, const glm::mat4& modelMatrix);
+      // nullptr for objects that can't be drawn
+      static const EngineModel* _drawnModel(EngineGameObject& object, const TransformSystem& transforms) { return transforms.contains(object.getId()) ? object.model.get() : nullptr; }
+      // returns false when the set of objects changed and the hierarchy has to be rebuilt
+      bool _updateBounds(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms);
+      void _rebuild(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms);
+      void _queryParallel(const Frustum& frustum);
+
+      BoundingVolumeHierarchy _hierarchy;
+      std::vector<Entry> _entries; // same order as gameObjects
+      std::vector<uint32_t> _visible;
+
+      JobSystem* _jobSystem = nullptr;
+      std::vector<uint32_t> _subtrees;
+      std::vector<std::vector<uint32_t>> _subtreeVisible;
+      std::vector<uint32_t> _subtreeNodesTested;
+
+      Statistics _statistics{};
+   };
+
+   // ========================================== implementation ==========================================
+
+   BoundingBox CullingSystem::_worldBounds(const EngineModel* model, const glm::mat4& modelMatrix) {
+      if (!model) return {};
+
+      // both are conservative, rotated boxes favor the sphere and elongated meshes favor the box
+      const BoundingBox fromBox = model->getBoundingBox().transformed(modelMatrix);
+      const BoundingBox fromSphere = model->getBoundingSphere().transformed(modelMatrix).box();
+      return fromBox.intersection(fromSphere);
+   }
+
+   bool CullingSystem::_updateBounds(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms) {
+      if (gameObjects.size() != _entries.size()) return false;
+
+      _statistics.boundsUpdated = 0;
+      for (uint32_t i = 0; i < gameObjects.size(); i++) {
+         auto& object = gameObjects[i];
+         auto& entry = _entries[i];
+         if (entry.id != object.getId()) return false;
+
+         const EngineModel* model = _drawnModel(object, transforms);
+         const uint64_t revision = model ? transforms.revision(entry.id) : 0;
+         if (entry.model == model && entry.revision == revision) continue;
+
+         entry.model = model;
+         entry.revision = revision;
+         _hierarchy.update(i, model ? _worldBounds(model, transforms.modelMatrix(entry.id)) : BoundingBox{});
+         _statistics.boundsUpdated++;
+      }
+      return _hierarchy.refit();
+   }
+
+   void CullingSystem::_rebuild(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms) {
+      _entries.resize(gameObjects.size());
+      std::vector<BoundingBox> bounds(gameObjects.size());
+
+      for (uint32_t i = 0; i < gameObjects.size(); i++) {
+         auto& object = gameObjects[i];
+         const EngineModel* model = _drawnModel(object, transforms);
+         _entries[i] = {object.getId(), model, model ? transforms.revision(object.getId()) : 0};
+         if (model) bounds[i] = _worldBounds(model, transforms.modelMatrix(object.getId()));
+      }
+
+      _hierarchy.build(std::move(bounds));
+      _statistics.boundsUpdated = static_cast<uint32_t>(gameObjects.size());
+      _statistics.rebuilt = true;
+   }
+
+   const std::vector<uint32_t>& CullingSystem::cull(std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const glm::mat4& projectionView) {
+      auto start = std::chrono::high_resolution_clock::now();
+
+      _statistics.rebuilt = false;
+      if (!_updateBounds(gameObjects, transforms)) _rebuild(gameObjects, transforms);
+
+      const Frustum frustum = Frustum::fromMatrix(projectionView);
+      _visible.clear();
+      if (_jobSystem && _hierarchy.size() >= PARALLEL_THRESHOLD) {
+         _queryParallel(frustum);
+      } else {
+         _statistics.nodesTested = _hierarchy.query(frustum, _visible);
+      }
+
+      _statistics.skipped = 0;
+      for (const auto& entry : _entries) _statistics.skipped += entry.model == nullptr;
+      _statistics.visible = static_cast<uint32_t>(_visible.size());
+      _statistics.culled = static_cast<uint32_t>(_entries.size() - _statistics.skipped - _visible.size());
+      auto end = std::chrono::high_resolution_clock::now();
+      _statistics.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+      return _visible;
+   }
+
+   void CullingSystem::_queryParallel(const Frustum& frustum) {
+      // a few subtrees per thread so a thread that got mostly culled subtrees can pick up more work
+      _hierarchy.splitSubtrees(_jobSystem->threadCount() * 4, _subtrees);
+      _subtreeVisible.resize(_subtrees.size());
+      _subtreeNodesTested.assign(_subtrees.size(), 0);
+
+      _jobSystem->parallelFor(static_cast<uint32_t>(_subtrees.size()), 1, [&](uint32_t begin, uint32_t end) {
+         ProfileScope scope{"cull subtree"};
+         for (uint32_t i = begin; i < end; i++) {
+            _subtreeVisible[i].clear();
+            _subtreeNodesTested[i] = _hierarchy.query(frustum, _subtreeVisible[i], _subtrees[i]);
+         }
+      });
+
+      _statistics.nodesTested = 0;
+      for (size_t i = 0; i < _subtrees.size(); i++) {
+         _visible.insert(_visible.end(), _subtreeVisible[i].begin(), _subtreeVisible[i].end());
+         _statistics.nodesTested += _subtreeNodesTested[i];
+      }
+   }
+} // namespace gears
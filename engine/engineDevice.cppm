@@ -1,5 +1,7 @@
 module;
 
+#include <cstring>
+#include <memory>
 #include <set>
 #include <vector>
 #include <unordered_set>
@@ -8,6 +10,7 @@ module;
 #include <GLFW/glfw3.h>
 
 export module engine.device;
+export import engine.memoryAllocator;
 import engine.window;
 import engine.logger;
 
@@ -35,6 +38,8 @@ namespace gears {
 #endif // GRS_DEBUG
 
       PhysicalDevice(Window& window);
+      // headless device without a surface or swap chain support, for offscreen rendering and benchmarks
+      PhysicalDevice();
       ~PhysicalDevice();
 
       // Not copyable or movable
@@ -48,19 +53,26 @@ namespace gears {
       VkSurfaceKHR surface() { return _surface; }
       VkQueue graphicsQueue() { return _graphicsQueue; }
       VkQueue presentQueue() { return _presentQueue; }
+      bool isHeadless() const { return _window == nullptr; }
 
       SwapChainSupportDetails getSwapChainSupport() { return _querySwapChainSupport(_physicalDevice); }
       uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
       QueueFamilyIndices findPhysicalQueueFamilies() { return _findQueueFamilies(_physicalDevice); }
+      // valid bits of the graphics queue's timestamps, 0 when it can't write timestamps
+      uint32_t graphicsTimestampValidBits();
       VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+      MemoryAllocator& allocator() { return *_allocator; }
+      StagingRing& stagingRing() { return *_stagingRing; }
+
       // Buffer Helper Functions
       void createBuffer(
           VkDeviceSize size,
           VkBufferUsageFlags usage,
           VkMemoryPropertyFlags properties,
           VkBuffer& buffer,
-          VkDeviceMemory& bufferMemory);
+          Allocation& bufferMemory);
+      void destroyBuffer(VkBuffer buffer, Allocation& bufferMemory);
       VkCommandBuffer beginSingleTimeCommands();
       void endSingleTimeCommands(VkCommandBuffer commandBuffer);
       void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -71,7 +83,8 @@ namespace gears {
           const VkImageCreateInfo& imageInfo,
           VkMemoryPropertyFlags properties,
           VkImage& image,
-          VkDeviceMemory& imageMemory);
+          Allocation& imageMemory);
+      void destroyImage(VkImage image, Allocation& imageMemory);
 
       VkPhysicalDeviceProperties properties;
 
@@ -96,16 +109,49 @@ namespace gears {
       VkInstance _instance;
       VkDebugUtilsMessengerEXT _debugMessenger;
       VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
-      Window& _window;
+      Window* _window = nullptr;
       VkCommandPool _commandPool;
 
       VkDevice _device;
-      VkSurfaceKHR _surface;
+      VkSurfaceKHR _surface = VK_NULL_HANDLE;
       VkQueue _graphicsQueue;
       VkQueue _presentQueue;
 
+      std::unique_ptr<MemoryAllocator> _allocator;
+      std::unique_ptr<StagingRing> _stagingRing;
+
       const std::vector<const char*> _validationLayers = {"VK_LAYER_KHRONOS_validation"};
-      const std::vector<const char*> _deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+      std::vector<const char*> _deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+   };
+
+   // records many staging copies into one command buffer that is submitted once and tracked with a fence
+   export class TransferBatch {
+   public:
+      TransferBatch(PhysicalDevice& device);
+      ~TransferBatch();
+
+      TransferBatch(const TransferBatch&) = delete;
+      TransferBatch& operator=(const TransferBatch&) = delete;
+
+      // copies size bytes of data into dstBuffer, data can be released as soon as this returns
+      void upload(VkBuffer dstBuffer, const void* data, VkDeviceSize size);
+
+      void submit();
+      bool isComplete();
+      void wait();
+
+   private:
+      struct StagingBuffer {
+         VkBuffer buffer;
+         Allocation memory;
+      };
+
+      PhysicalDevice& _device;
+      VkCommandBuffer _commandBuffer;
+      VkFence _fence;
+      std::vector<uint64_t> _stagingTickets;
+      std::vector<StagingBuffer> _stagingBuffers; // only for uploads that didn't fit in the staging ring
+      bool _submitted = false;
    };
 
    // ========================================== implementation ==========================================
@@ -151,16 +197,33 @@ namespace gears {
    }
 
    // class member functions
-   PhysicalDevice::PhysicalDevice(Window& window) : _window{window} {
+   PhysicalDevice::PhysicalDevice(Window& window) : _window{&window} {
       _createInstance();
       _setupDebugMessenger();
       _createSurface();
       _pickPhysicalDevice();
       _createLogicalDevice();
       _createCommandPool();
+
+      _allocator = std::make_unique<MemoryAllocator>(_physicalDevice, _device);
+      _stagingRing = std::make_unique<StagingRing>(_device, *_allocator);
+   }
+
+   PhysicalDevice::PhysicalDevice() : _deviceExtensions{} {
+      _createInstance();
+      _setupDebugMessenger();
+      _pickPhysicalDevice();
+      _createLogicalDevice();
+      _createCommandPool();
+
+      _allocator = std::make_unique<MemoryAllocator>(_physicalDevice, _device);
+      _stagingRing = std::make_unique<StagingRing>(_device, *_allocator);
    }
 
    PhysicalDevice::~PhysicalDevice() {
+      _stagingRing.reset();
+      _allocator.reset();
+
       vkDestroyCommandPool(_device, _commandPool, nullptr);
       vkDestroyDevice(_device, nullptr);
 
@@ -168,7 +231,7 @@ namespace gears {
          DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
       }
 
-      vkDestroySurfaceKHR(_instance, _surface, nullptr);
+      if (_surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(_instance, _surface, nullptr);
       vkDestroyInstance(_instance, nullptr);
    }
 
@@ -266,6 +329,7 @@ namespace gears {
 
       VkPhysicalDeviceFeatures deviceFeatures = {};
       deviceFeatures.samplerAnisotropy = VK_TRUE;
+      deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
       VkDeviceCreateInfo createInfo = {};
       createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -307,15 +371,15 @@ namespace gears {
       }
    }
 
-   void PhysicalDevice::_createSurface() { _window.createWindowSurface(_instance, &_surface); }
+   void PhysicalDevice::_createSurface() { _window->createWindowSurface(_instance, &_surface); }
 
    bool PhysicalDevice::_isDeviceSuitable(VkPhysicalDevice device) {
       QueueFamilyIndices indices = _findQueueFamilies(device);
 
       bool extensionsSupported = _checkDeviceExtensionSupport(device);
 
-      bool swapChainAdequate = false;
-      if (extensionsSupported) {
+      bool swapChainAdequate = isHeadless();
+      if (extensionsSupported && !isHeadless()) {
          SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(device);
          swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
       }
@@ -324,7 +388,7 @@ namespace gears {
       vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
       return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-          supportedFeatures.samplerAnisotropy;
+          supportedFeatures.samplerAnisotropy && supportedFeatures.drawIndirectFirstInstance;
    }
 
    void PhysicalDevice::_populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
@@ -368,11 +432,14 @@ namespace gears {
    }
 
    std::vector<const char*> PhysicalDevice::_getRequiredExtensions() {
-      uint32_t glfwExtensionCount = 0;
-      const char** glfwExtensions;
-      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      std::vector<const char*> extensions;
 
-      std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+      if (!isHeadless()) {
+         uint32_t glfwExtensionCount = 0;
+         const char** glfwExtensions;
+         glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+         extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+      }
 
       if (enableValidationLayers) {
          extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -424,6 +491,15 @@ namespace gears {
       return requiredExtensions.empty();
    }
 
+   uint32_t PhysicalDevice::graphicsTimestampValidBits() {
+      uint32_t queueFamilyCount = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+      std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+      vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+      return queueFamilies[findPhysicalQueueFamilies().graphicsFamily].timestampValidBits;
+   }
+
    QueueFamilyIndices PhysicalDevice::_findQueueFamilies(VkPhysicalDevice device) {
       QueueFamilyIndices indices;
 
@@ -439,8 +515,11 @@ namespace gears {
             indices.graphicsFamily = i;
             indices.graphicsFamilyHasValue = true;
          }
+         // headless devices never present, the graphics queue stands in for the present one
          VkBool32 presentSupport = false;
-         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+         if (isHeadless()) presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+         else
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
          if (queueFamily.queueCount > 0 && presentSupport) {
             indices.presentFamily = i;
             indices.presentFamilyHasValue = true;
@@ -498,16 +577,7 @@ namespace gears {
    }
 
    uint32_t PhysicalDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-      VkPhysicalDeviceMemoryProperties memProperties;
-      vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
-      for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-         if ((typeFilter & (1 << i)) &&
-             (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-         }
-      }
-
-      throw Logger::Exception("failed to find suitable memory type!");
+      return _allocator->findMemoryType(typeFilter, properties);
    }
 
    void PhysicalDevice::createBuffer(
@@ -515,7 +585,7 @@ namespace gears {
        VkBufferUsageFlags usage,
        VkMemoryPropertyFlags properties,
        VkBuffer& buffer,
-       VkDeviceMemory& bufferMemory) {
+       Allocation& bufferMemory) {
       VkBufferCreateInfo bufferInfo{};
       bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
       bufferInfo.size = size;
@@ -529,16 +599,13 @@ namespace gears {
       VkMemoryRequirements memRequirements;
       vkGetBufferMemoryRequirements(_device, buffer, &memRequirements);
 
-      VkMemoryAllocateInfo allocInfo{};
-      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      allocInfo.allocationSize = memRequirements.size;
-      allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-      if (vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-         throw Logger::Exception("failed to allocate vertex buffer memory!");
-      }
+      bufferMemory = _allocator->allocate(memRequirements, properties);
+      vkBindBufferMemory(_device, buffer, bufferMemory.memory, bufferMemory.offset);
+   }
 
-      vkBindBufferMemory(_device, buffer, bufferMemory, 0);
+   void PhysicalDevice::destroyBuffer(VkBuffer buffer, Allocation& bufferMemory) {
+      vkDestroyBuffer(_device, buffer, nullptr);
+      _allocator->free(bufferMemory);
    }
 
    VkCommandBuffer PhysicalDevice::beginSingleTimeCommands() {
@@ -562,14 +629,24 @@ namespace gears {
    void PhysicalDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
       vkEndCommandBuffer(commandBuffer);
 
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+      VkFence fence;
+      if (vkCreateFence(_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create fence!");
+      }
+
       VkSubmitInfo submitInfo{};
       submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
       submitInfo.commandBufferCount = 1;
       submitInfo.pCommandBuffers = &commandBuffer;
 
-      vkQueueSubmit(_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-      vkQueueWaitIdle(_graphicsQueue);
+      // waiting on this submission only instead of draining the whole queue
+      vkQueueSubmit(_graphicsQueue, 1, &submitInfo, fence);
+      vkWaitForFences(_device, 1, &fence, VK_TRUE, UINT64_MAX);
 
+      vkDestroyFence(_device, fence, nullptr);
       vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
    }
 
@@ -616,7 +693,7 @@ namespace gears {
        const VkImageCreateInfo& imageInfo,
        VkMemoryPropertyFlags properties,
        VkImage& image,
-       VkDeviceMemory& imageMemory) {
+       Allocation& imageMemory) {
       if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
          throw Logger::Exception("failed to create image!");
       }
@@ -624,18 +701,100 @@ namespace gears {
       VkMemoryRequirements memRequirements;
       vkGetImageMemoryRequirements(_device, image, &memRequirements);
 
-      VkMemoryAllocateInfo allocInfo{};
-      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      allocInfo.allocationSize = memRequirements.size;
-      allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+      imageMemory = _allocator->allocate(memRequirements, properties);
 
-      if (vkAllocateMemory(_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-         throw Logger::Exception("failed to allocate image memory!");
+      if (vkBindImageMemory(_device, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
+         throw Logger::Exception("failed to bind image memory!");
       }
+   }
 
-      if (vkBindImageMemory(_device, image, imageMemory, 0) != VK_SUCCESS) {
-         throw Logger::Exception("failed to bind image memory!");
+   void PhysicalDevice::destroyImage(VkImage image, Allocation& imageMemory) {
+      vkDestroyImage(_device, image, nullptr);
+      _allocator->free(imageMemory);
+   }
+
+   TransferBatch::TransferBatch(PhysicalDevice& device) : _device{device} {
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+      if (vkCreateFence(_device.device(), &fenceInfo, nullptr, &_fence) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create transfer fence!");
+      }
+
+      _commandBuffer = _device.beginSingleTimeCommands();
+   }
+
+   TransferBatch::~TransferBatch() {
+      if (_submitted) wait();
+
+      for (uint64_t ticket : _stagingTickets) _device.stagingRing().release(ticket);
+      for (auto& staging : _stagingBuffers) _device.destroyBuffer(staging.buffer, staging.memory);
+
+      vkFreeCommandBuffers(_device.device(), _device.getCommandPool(), 1, &_commandBuffer);
+      vkDestroyFence(_device.device(), _fence, nullptr);
+   }
+
+   void TransferBatch::upload(VkBuffer dstBuffer, const void* data, VkDeviceSize size) {
+      if (_submitted) throw Logger::Exception("can't record an upload into a batch that was already submitted!");
+
+      VkBufferCopy copyRegion{};
+      copyRegion.size = size;
+
+      StagingRing::Region region;
+      if (_device.stagingRing().allocate(size, region)) {
+         _stagingTickets.push_back(region.ticket);
+         memcpy(region.mapped, data, static_cast<size_t>(size));
+
+         copyRegion.srcOffset = region.offset;
+         vkCmdCopyBuffer(_commandBuffer, region.buffer, dstBuffer, 1, &copyRegion);
+         return;
       }
+
+      StagingBuffer staging;
+      _device.createBuffer(
+          size,
+          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          staging.buffer,
+          staging.memory);
+      _stagingBuffers.push_back(staging);
+
+      memcpy(staging.memory.mapped, data, static_cast<size_t>(size));
+      vkCmdCopyBuffer(_commandBuffer, staging.buffer, dstBuffer, 1, &copyRegion);
+   }
+
+   void TransferBatch::submit() {
+      if (_submitted) throw Logger::Exception("transfer batch submitted twice!");
+
+      // makes the copied data visible to every draw recorded after this submission
+      VkMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+      vkCmdPipelineBarrier(_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+      if (vkEndCommandBuffer(_commandBuffer) != VK_SUCCESS) {
+         throw Logger::Exception("failed to record transfer command buffer!");
+      }
+
+      VkSubmitInfo submitInfo{};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &_commandBuffer;
+
+      if (vkQueueSubmit(_device.graphicsQueue(), 1, &submitInfo, _fence) != VK_SUCCESS) {
+         throw Logger::Exception("failed to submit transfer command buffer!");
+      }
+      _submitted = true;
+   }
+
+   bool TransferBatch::isComplete() {
+      return _submitted && vkGetFenceStatus(_device.device(), _fence) == VK_SUCCESS;
+   }
+
+   void TransferBatch::wait() {
+      if (!_submitted) throw Logger::Exception("can't wait on a transfer batch that was never submitted!");
+      vkWaitForFences(_device.device(), 1, &_fence, VK_TRUE, UINT64_MAX);
    }
 
 } // namespace gears
\ No newline at end of file
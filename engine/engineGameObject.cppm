@@ -39,8 +39,7 @@ namespace gears {
 
       std::shared_ptr<EngineModel> model{};
       glm::vec3 color{};
-
-      TransformComponent transform{};
+      // the transform lives in a TransformSystem, keyed by getId()
 
    private:
       EngineGameObject(id_t objId) : _id{objId} {}
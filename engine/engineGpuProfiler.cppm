@@ -0,0 +1,186 @@
+module;
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+export module engine.gpuProfiler;
+import engine.device;
+import engine.logger;
+import engine.profiler;
+import engine.swapChain;
+
+namespace gears {
+
+   // timestamp queries around the scopes of a frame, one query pool per frame in flight. a frame's results
+   // are read back when its slot comes around again, after the renderer waited for its fence, so reading
+   // them never stalls. only records while the global profiler is enabled
+   export class GpuProfiler {
+   public:
+      // per frame, including the one covering the whole frame
+      static constexpr uint32_t MAX_SCOPES = 32;
+      static constexpr uint32_t INVALID_SCOPE = ~0u;
+
+      // begins a scope on construction and ends it on destruction
+      class Scope {
+      public:
+         Scope(GpuProfiler* gpuProfiler, VkCommandBuffer commandBuffer, const char* name)
+             : _gpuProfiler{gpuProfiler}, _commandBuffer{commandBuffer}, _scope{gpuProfiler ? gpuProfiler->beginScope(commandBuffer, name) : INVALID_SCOPE} {}
+         ~Scope() {
+            if (_gpuProfiler) _gpuProfiler->endScope(_commandBuffer, _scope);
+         }
+
+         Scope(const Scope&) = delete;
+         Scope& operator=(const Scope&) = delete;
+
+      private:
+         GpuProfiler* _gpuProfiler;
+         VkCommandBuffer _commandBuffer;
+         uint32_t _scope;
+      };
+
+      GpuProfiler(PhysicalDevice& device);
+      ~GpuProfiler();
+
+      GpuProfiler(const GpuProfiler&) = delete;
+      GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+      bool isSupported() const { return _timestampMask != 0; }
+
+      // right after beginning commandBuffer, outside of any render pass. the previous submission of frameIndex
+      // has to be complete
+      void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+      // right before ending commandBuffer
+      void endFrame(VkCommandBuffer commandBuffer);
+      // reads back the frames that haven't come around again yet, every submitted frame has to be complete
+      void readPendingResults();
+
+      uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name) {
+         const uint32_t scope = addScope(name);
+         writeBegin(commandBuffer, scope);
+         return scope;
+      }
+      void endScope(VkCommandBuffer commandBuffer, uint32_t scope) { writeEnd(commandBuffer, scope); }
+
+      // a scope can begin and end in different command buffers of the frame, like the first and last of the
+      // secondary command buffers recorded inside a render pass, where the primary can't write timestamps.
+      // addScope isn't thread safe, the writes are
+      uint32_t addScope(const char* name);
+      void writeBegin(VkCommandBuffer commandBuffer, uint32_t scope);
+      void writeEnd(VkCommandBuffer commandBuffer, uint32_t scope);
+
+   private:
+      struct Frame {
+         VkQueryPool queryPool = VK_NULL_HANDLE;
+         std::vector<const char*> names;
+         int64_t cpuSubmitTime = 0;
+         bool recorded = false;
+      };
+
+      void _readResults(Frame& frame);
+
+      PhysicalDevice& _device;
+      float _timestampPeriod; // nanoseconds per tick
+      uint64_t _timestampMask = 0;
+      std::array<Frame, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> _frames{};
+      Frame* _currentFrame = nullptr; // null outside of a profiled frame
+      std::vector<uint64_t> _results;
+   };
+
+   //  ========================================== implementation ==========================================
+
+   GpuProfiler::GpuProfiler(PhysicalDevice& device) : _device{device}, _timestampPeriod{device.properties.limits.timestampPeriod} {
+      const uint32_t validBits = _device.graphicsTimestampValidBits();
+      if (validBits == 0) {
+         logger->warn("the graphics queue doesn't support timestamps, gpu scopes won't be profiled");
+         return;
+      }
+      _timestampMask = validBits >= 64 ? ~uint64_t{0} : (uint64_t{1} << validBits) - 1;
+
+      VkQueryPoolCreateInfo queryPoolInfo{};
+      queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      queryPoolInfo.queryCount = MAX_SCOPES * 2;
+      for (auto& frame : _frames) {
+         if (vkCreateQueryPool(_device.device(), &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS) throw Logger::Exception("failed to create timestamp query pool");
+         frame.names.reserve(MAX_SCOPES);
+      }
+      _results.resize(MAX_SCOPES * 2);
+   }
+
+   GpuProfiler::~GpuProfiler() {
+      for (auto& frame : _frames) {
+         if (frame.queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(_device.device(), frame.queryPool, nullptr);
+      }
+   }
+
+   void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+      _currentFrame = nullptr;
+      if (!isSupported()) return;
+
+      Frame& frame = _frames[frameIndex];
+      if (frame.recorded) _readResults(frame);
+      frame.recorded = false;
+      frame.names.clear();
+      if (!profiler || !profiler->isEnabled()) return;
+
+      vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_SCOPES * 2);
+      _currentFrame = &frame;
+      beginScope(commandBuffer, "gpu frame");
+   }
+
+   void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+      if (!_currentFrame) return;
+
+      endScope(commandBuffer, 0);
+      // without calibrated timestamps the gpu timeline is placed where the frame gets submitted, it starts
+      // executing shortly after that
+      _currentFrame->cpuSubmitTime = profiler->now();
+      _currentFrame->recorded = true;
+      _currentFrame = nullptr;
+   }
+
+   void GpuProfiler::readPendingResults() {
+      for (auto& frame : _frames) {
+         if (frame.recorded) _readResults(frame);
+         frame.recorded = false;
+      }
+   }
+
+   uint32_t GpuProfiler::addScope(const char* name) {
+      if (!_currentFrame || _currentFrame->names.size() == MAX_SCOPES) return INVALID_SCOPE;
+
+      _currentFrame->names.push_back(name);
+      return static_cast<uint32_t>(_currentFrame->names.size() - 1);
+   }
+
+   void GpuProfiler::writeBegin(VkCommandBuffer commandBuffer, uint32_t scope) {
+      if (!_currentFrame || scope == INVALID_SCOPE) return;
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _currentFrame->queryPool, scope * 2);
+   }
+
+   void GpuProfiler::writeEnd(VkCommandBuffer commandBuffer, uint32_t scope) {
+      if (!_currentFrame || scope == INVALID_SCOPE) return;
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _currentFrame->queryPool, scope * 2 + 1);
+   }
+
+   void GpuProfiler::_readResults(Frame& frame) {
+      const uint32_t queryCount = static_cast<uint32_t>(frame.names.size()) * 2;
+      // no wait flag: the frame's fence has been waited on, anything not available means it was never submitted
+      if (vkGetQueryPoolResults(_device.device(), frame.queryPool, 0, queryCount, queryCount * sizeof(uint64_t), _results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return;
+      if (!profiler) return;
+
+      const uint64_t frameStart = _results[0] & _timestampMask;
+      auto toNanoseconds = [&](uint64_t ticks) { return static_cast<int64_t>(static_cast<double>(ticks & _timestampMask) * _timestampPeriod); };
+
+      for (uint32_t scope = 0; scope < frame.names.size(); scope++) {
+         const uint64_t begin = _results[scope * 2] & _timestampMask;
+         const uint64_t end = _results[scope * 2 + 1] & _timestampMask;
+         // masked subtraction handles counters that wrapped around during the frame
+         profiler->recordGpu(frame.names[scope], frame.cpuSubmitTime + toNanoseconds(begin - frameStart), toNanoseconds(end - begin));
+      }
+      profiler->addGpuFrameTime(static_cast<float>(toNanoseconds((_results[1] & _timestampMask) - frameStart)) / 1e6f);
+   }
+} // namespace gears
@@ -0,0 +1,230 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module engine.jobSystem;
+
+namespace gears {
+
+   // work stealing job system for short, cpu bound jobs inside a frame. every thread has its own queue:
+   // jobs are pushed to and popped from the back by the thread that submitted them and stolen from the
+   // front by idle threads. the thread waiting on a group runs jobs too, so it never just sleeps.
+   // long or blocking work (file io, ...) belongs on a ThreadPool instead
+   export class JobSystem {
+   public:
+      // tracks the jobs submitted with it, must outlive them
+      class WaitGroup {
+      public:
+         bool isDone() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+      private:
+         friend class JobSystem;
+         std::atomic<uint32_t> _pending{0};
+         std::mutex _errorMutex;
+         std::exception_ptr _error{}; // first exception thrown by one of the jobs, guarded by _errorMutex
+      };
+
+      // threadCount counts the thread that waits for the jobs, 0 uses every hardware thread
+      JobSystem(uint32_t threadCount = 0);
+      ~JobSystem();
+
+      JobSystem(const JobSystem&) = delete;
+      JobSystem& operator=(const JobSystem&) = delete;
+
+      // number of threads that run jobs, including the waiting one
+      uint32_t threadCount() const { return static_cast<uint32_t>(_queues.size()); }
+      // 1 to threadCount() - 1 on the workers, 0 on every other thread
+      static uint32_t threadIndex();
+
+      void submit(WaitGroup& group, std::function<void()> job);
+      // runs queued jobs until every job of group has finished, then rethrows the first exception one of them threw
+      void wait(WaitGroup& group);
+
+      // calls func(begin, end) for chunks of at most chunkSize items covering [0, count) and waits for them
+      template <typename Func>
+      void parallelFor(uint32_t count, uint32_t chunkSize, Func&& func);
+
+   private:
+      // failed attempts at finding a job before a waiting thread goes to sleep until a job of its group finishes
+      static constexpr uint32_t SPIN_COUNT = 64;
+
+      struct Job {
+         std::function<void()> function;
+         WaitGroup* group;
+      };
+
+      struct Queue {
+         std::mutex mutex;
+         std::deque<Job> jobs;
+      };
+
+      void _runUntilDone(WaitGroup& group);
+      bool _tryRunJob(uint32_t threadIndex);
+      void _workerLoop(std::stop_token stopToken, uint32_t threadIndex);
+
+      std::vector<std::unique_ptr<Queue>> _queues; // one per thread, index 0 is shared by non worker threads
+      std::atomic<uint32_t> _queuedJobs{0};
+
+      std::mutex _sleepMutex;
+      std::condition_variable_any _wakeCondition;
+      // notified whenever a group's last job finishes
+      std::mutex _doneMutex;
+      std::condition_variable _doneCondition;
+      std::vector<std::jthread> _workers; // declared last so the workers are joined before anything else is destroyed
+   };
+
+   //  ========================================== implementation ==========================================
+
+   thread_local uint32_t currentThreadIndex = 0;
+
+   JobSystem::JobSystem(uint32_t threadCount) {
+      if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+      _queues.reserve(threadCount);
+      for (uint32_t i = 0; i < threadCount; i++) _queues.push_back(std::make_unique<Queue>());
+
+      _workers.reserve(threadCount - 1);
+      for (uint32_t i = 1; i < threadCount; i++) {
+         _workers.emplace_back([this, i](std::stop_token stopToken) { _workerLoop(stopToken, i); });
+      }
+   }
+
+   JobSystem::~JobSystem() {
+      for (auto& worker : _workers) worker.request_stop();
+      _wakeCondition.notify_all();
+   }
+
+   uint32_t JobSystem::threadIndex() { return currentThreadIndex; }
+
+   void JobSystem::submit(WaitGroup& group, std::function<void()> job) {
+      group._pending.fetch_add(1, std::memory_order_relaxed);
+
+      const uint32_t index = currentThreadIndex < _queues.size() ? currentThreadIndex : 0;
+      {
+         std::lock_guard lock{_queues[index]->mutex};
+         _queues[index]->jobs.push_back({std::move(job), &group});
+      }
+      {
+         // under the sleep mutex so a worker can't miss the wake up between checking the count and sleeping
+         std::lock_guard lock{_sleepMutex};
+         _queuedJobs.fetch_add(1, std::memory_order_release);
+      }
+      _wakeCondition.notify_one();
+   }
+
+   void JobSystem::wait(WaitGroup& group) {
+      _runUntilDone(group);
+
+      // every job is done, nothing else touches the error anymore
+      if (auto error = std::exchange(group._error, nullptr)) std::rethrow_exception(error);
+   }
+
+   void JobSystem::_runUntilDone(WaitGroup& group) {
+      const uint32_t index = currentThreadIndex < _queues.size() ? currentThreadIndex : 0;
+      uint32_t idleCount = 0;
+      while (!group.isDone()) {
+         if (_tryRunJob(index)) {
+            idleCount = 0;
+            continue;
+         }
+         if (++idleCount < SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+         }
+
+         // the group's last jobs are running on other threads, spinning for as long as they take would burn a core
+         std::unique_lock lock{_doneMutex};
+         _doneCondition.wait(lock, [&] { return group.isDone() || _queuedJobs.load(std::memory_order_acquire) > 0; });
+         idleCount = 0;
+      }
+   }
+
+   template <typename Func>
+   void JobSystem::parallelFor(uint32_t count, uint32_t chunkSize, Func&& func) {
+      if (count == 0) return;
+      chunkSize = std::max(chunkSize, 1u);
+
+      WaitGroup group;
+      try {
+         for (uint32_t begin = 0; begin < count; begin += chunkSize) {
+            const uint32_t end = std::min(count, begin + chunkSize);
+            submit(group, [&func, begin, end] { func(begin, end); });
+         }
+      } catch (...) {
+         // the chunks submitted so far reference func and group
+         _runUntilDone(group);
+         throw;
+      }
+      wait(group);
+   }
+
+   bool JobSystem::_tryRunJob(uint32_t threadIndex) {
+      if (_queuedJobs.load(std::memory_order_acquire) == 0) return false;
+
+      std::optional<Job> job;
+      {
+         auto& own = *_queues[threadIndex];
+         std::lock_guard lock{own.mutex};
+         if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+         }
+      }
+      for (uint32_t i = 1; !job && i < _queues.size(); i++) {
+         auto& victim = *_queues[(threadIndex + i) % _queues.size()];
+         std::lock_guard lock{victim.mutex};
+         if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+         }
+      }
+      if (!job) return false;
+
+      _queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+      // the group may be destroyed as soon as its count reaches 0, so the error is stored before and the
+      // waiting threads are woken through the job system
+      struct Completion {
+         JobSystem* jobSystem;
+         WaitGroup* group;
+         ~Completion() {
+            if (group->_pending.fetch_sub(1, std::memory_order_release) != 1) return;
+            // a waiter checks the count under the mutex, so it's either asleep or sees 0
+            { std::lock_guard lock{jobSystem->_doneMutex}; }
+            jobSystem->_doneCondition.notify_all();
+         }
+      } completion{this, job->group};
+
+      try {
+         job->function();
+      } catch (...) {
+         // thrown on a worker it would terminate the process, the waiting thread rethrows it instead
+         std::lock_guard lock{job->group->_errorMutex};
+         if (!job->group->_error) job->group->_error = std::current_exception();
+      }
+      return true;
+   }
+
+   void JobSystem::_workerLoop(std::stop_token stopToken, uint32_t threadIndex) {
+      currentThreadIndex = threadIndex;
+
+      while (!stopToken.stop_requested()) {
+         if (_tryRunJob(threadIndex)) continue;
+
+         std::unique_lock lock{_sleepMutex};
+         _wakeCondition.wait(lock, stopToken, [this] { return _queuedJobs.load(std::memory_order_acquire) > 0; });
+      }
+   }
+} // namespace gears
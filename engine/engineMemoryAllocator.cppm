@@ -0,0 +1,387 @@
+module;
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+export module engine.memoryAllocator;
+import engine.logger;
+
+namespace gears {
+
+   struct MemoryBlock;
+
+   export struct Allocation {
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      VkDeviceSize offset = 0;
+      VkDeviceSize size = 0;
+      void* mapped = nullptr; // persistently mapped pointer to offset, only for host visible memory
+
+      uint32_t memoryType = 0;
+      MemoryBlock* block = nullptr; // owning block, used by MemoryAllocator::free
+   };
+
+   // one vkAllocateMemory that allocations are carved out of, owned by the MemoryAllocator
+   struct MemoryBlock {
+      VkDeviceMemory memory;
+      VkDeviceSize size;
+      std::byte* mapped;
+      uint32_t memoryType;
+      bool dedicated; // sized for a single resource
+      uint32_t allocationCount = 0;
+      std::map<VkDeviceSize, VkDeviceSize> freeRanges{}; // offset -> size
+   };
+
+   // sub-allocates buffers and images from large per memory type blocks instead of calling
+   // vkAllocateMemory for every resource, free ranges are kept sorted and coalesced on free
+   export class MemoryAllocator {
+   public:
+      static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+      struct Statistics {
+         VkDeviceSize used = 0;
+         VkDeviceSize reserved = 0;
+         uint32_t allocationCount = 0;
+         uint32_t blockCount = 0;
+         float fragmentation = 0.f; // 1 - largest free range / total free space
+      };
+
+      MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+      ~MemoryAllocator();
+
+      MemoryAllocator(const MemoryAllocator&) = delete;
+      MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+      Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+      void free(Allocation& allocation);
+
+      uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+      uint32_t memoryTypeCount() const { return _memoryProperties.memoryTypeCount; }
+      Statistics getStatistics(uint32_t memoryType) const;
+      void logStatistics() const;
+
+   private:
+      MemoryBlock* _createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+      void _destroyBlock(MemoryBlock* block);
+      static bool _allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+      VkDevice _device;
+      VkDeviceSize _blockSize;
+      VkDeviceSize _bufferImageGranularity;
+      VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+      mutable std::mutex _mutex;
+      std::vector<std::unique_ptr<MemoryBlock>> _blocks[VK_MAX_MEMORY_TYPES];
+      VkDeviceSize _used[VK_MAX_MEMORY_TYPES]{};
+      uint32_t _emptyBlocks[VK_MAX_MEMORY_TYPES]{}; // blocks without allocations
+   };
+
+   // persistently mapped staging buffer used as a ring, regions are handed out in order and their
+   // space is reused once every region allocated before them has been released
+   export class StagingRing {
+   public:
+      static constexpr VkDeviceSize DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+      struct Region {
+         VkBuffer buffer;
+         VkDeviceSize offset;
+         void* mapped;
+         uint64_t ticket;
+      };
+
+      StagingRing(VkDevice device, MemoryAllocator& allocator, VkDeviceSize capacity = DEFAULT_CAPACITY);
+      ~StagingRing();
+
+      StagingRing(const StagingRing&) = delete;
+      StagingRing& operator=(const StagingRing&) = delete;
+
+      // returns false if there's no room left, callers should fall back to a dedicated staging buffer
+      bool allocate(VkDeviceSize size, Region& region);
+      // must only be called once the gpu is done reading the region
+      void release(uint64_t ticket);
+
+   private:
+      struct InFlight {
+         VkDeviceSize begin;
+         VkDeviceSize end;
+         uint64_t ticket;
+         bool released;
+      };
+
+      VkDevice _device;
+      MemoryAllocator& _allocator;
+      VkDeviceSize _capacity;
+      VkBuffer _buffer;
+      Allocation _allocation;
+
+      std::mutex _mutex;
+      std::deque<InFlight> _inFlight;
+      uint64_t _nextTicket = 0;
+   };
+
+   // ========================================== implementation ==========================================
+
+   VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+      return (value + alignment - 1) / alignment * alignment;
+   }
+
+   MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+       : _device{device}, _blockSize{blockSize} {
+      vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+      _bufferImageGranularity = properties.limits.bufferImageGranularity;
+   }
+
+   MemoryAllocator::~MemoryAllocator() {
+      for (auto& blocks : _blocks) {
+         for (auto& block : blocks) {
+            if (block->allocationCount > 0) logger->warn("destroying a memory block with {} live allocations", block->allocationCount);
+            vkFreeMemory(_device, block->memory, nullptr);
+         }
+      }
+   }
+
+   uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+      for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+         if ((typeFilter & (1 << i)) &&
+             (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+         }
+      }
+
+      throw Logger::Exception("failed to find suitable memory type!");
+   }
+
+   MemoryBlock* MemoryAllocator::_createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated) {
+      VkMemoryAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = size;
+      allocInfo.memoryTypeIndex = memoryType;
+
+      auto block = std::make_unique<MemoryBlock>();
+      block->size = size;
+      block->memoryType = memoryType;
+      block->mapped = nullptr;
+      block->dedicated = dedicated;
+      block->freeRanges.emplace(0, size);
+
+      if (vkAllocateMemory(_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+         throw Logger::Exception("failed to allocate a {} byte memory block!", size);
+      }
+
+      if (_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+         void* mapped;
+         if (vkMapMemory(_device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            vkFreeMemory(_device, block->memory, nullptr);
+            throw Logger::Exception("failed to map memory block!");
+         }
+         block->mapped = static_cast<std::byte*>(mapped);
+      }
+
+      _blocks[memoryType].push_back(std::move(block));
+      _emptyBlocks[memoryType]++;
+      return _blocks[memoryType].back().get();
+   }
+
+   void MemoryAllocator::_destroyBlock(MemoryBlock* block) {
+      auto& blocks = _blocks[block->memoryType];
+      auto it = std::find_if(blocks.begin(), blocks.end(), [block](const auto& b) { return b.get() == block; });
+
+      vkFreeMemory(_device, block->memory, nullptr);
+      blocks.erase(it);
+   }
+
+   bool MemoryAllocator::_allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+      // first fit, the alignment padding in front of the allocation stays in the free list
+      for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+         const auto [rangeOffset, rangeSize] = *it;
+         const VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+         if (alignedOffset + size > rangeOffset + rangeSize) continue;
+
+         block.freeRanges.erase(it);
+         if (alignedOffset > rangeOffset) block.freeRanges.emplace(rangeOffset, alignedOffset - rangeOffset);
+         if (alignedOffset + size < rangeOffset + rangeSize) block.freeRanges.emplace(alignedOffset + size, rangeOffset + rangeSize - alignedOffset - size);
+
+         offset = alignedOffset;
+         return true;
+      }
+      return false;
+   }
+
+   Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties) {
+      const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+      // buffers and optimal images share blocks, aligning everything to the granularity keeps them apart
+      const VkDeviceSize alignment = std::max(requirements.alignment, _bufferImageGranularity);
+      const VkDeviceSize size = alignUp(requirements.size, alignment);
+
+      std::lock_guard lock{_mutex};
+
+      Allocation allocation{};
+      allocation.memoryType = memoryType;
+      allocation.size = size;
+
+      MemoryBlock* block = nullptr;
+      for (auto& candidate : _blocks[memoryType]) {
+         if (_allocateFromBlock(*candidate, size, alignment, allocation.offset)) {
+            block = candidate.get();
+            break;
+         }
+      }
+
+      if (!block) {
+         // resources bigger than half a block get a block of their own
+         const bool dedicated = size > _blockSize / 2;
+         block = _createBlock(memoryType, dedicated ? size : _blockSize, dedicated);
+         _allocateFromBlock(*block, size, alignment, allocation.offset);
+      }
+
+      if (block->allocationCount++ == 0) _emptyBlocks[memoryType]--;
+      _used[memoryType] += size;
+
+      allocation.memory = block->memory;
+      allocation.mapped = block->mapped ? block->mapped + allocation.offset : nullptr;
+      allocation.block = block;
+      return allocation;
+   }
+
+   void MemoryAllocator::free(Allocation& allocation) {
+      if (!allocation.block) return;
+
+      std::lock_guard lock{_mutex};
+
+      MemoryBlock& block = *allocation.block;
+      auto [it, inserted] = block.freeRanges.emplace(allocation.offset, allocation.size);
+
+      // merging with the following and the preceding free range
+      auto next = std::next(it);
+      if (next != block.freeRanges.end() && it->first + it->second == next->first) {
+         it->second += next->second;
+         block.freeRanges.erase(next);
+      }
+      if (it != block.freeRanges.begin()) {
+         auto prev = std::prev(it);
+         if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            block.freeRanges.erase(it);
+         }
+      }
+
+      block.allocationCount--;
+      _used[allocation.memoryType] -= allocation.size;
+
+      // one empty block per memory type is kept around so alloc/free cycles don't hit the driver, a dedicated
+      // block only fits the resource it was made for
+      if (block.allocationCount == 0) {
+         if (block.dedicated || _emptyBlocks[allocation.memoryType] > 0) _destroyBlock(&block);
+         else
+            _emptyBlocks[allocation.memoryType]++;
+      }
+
+      allocation = Allocation{};
+   }
+
+   MemoryAllocator::Statistics MemoryAllocator::getStatistics(uint32_t memoryType) const {
+      std::lock_guard lock{_mutex};
+
+      Statistics stats{};
+      VkDeviceSize totalFree = 0;
+      VkDeviceSize largestFree = 0;
+      for (const auto& block : _blocks[memoryType]) {
+         stats.reserved += block->size;
+         stats.allocationCount += block->allocationCount;
+         stats.blockCount++;
+         for (const auto& [offset, size] : block->freeRanges) {
+            totalFree += size;
+            largestFree = std::max(largestFree, size);
+         }
+      }
+      stats.used = _used[memoryType];
+      stats.fragmentation = totalFree > 0 ? 1.f - static_cast<float>(largestFree) / static_cast<float>(totalFree) : 0.f;
+      return stats;
+   }
+
+   void MemoryAllocator::logStatistics() const {
+      for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+         const Statistics stats = getStatistics(i);
+         if (stats.blockCount == 0) continue;
+
+         logger->log("memory type {}: {} allocations in {} blocks, {:.2f} / {:.2f} MiB used, {:.1f}% fragmented",
+                     i, stats.allocationCount, stats.blockCount, stats.used / 1048576.0, stats.reserved / 1048576.0, stats.fragmentation * 100.f);
+      }
+   }
+
+   StagingRing::StagingRing(VkDevice device, MemoryAllocator& allocator, VkDeviceSize capacity)
+       : _device{device}, _allocator{allocator}, _capacity{capacity} {
+      VkBufferCreateInfo bufferInfo{};
+      bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferInfo.size = capacity;
+      bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+      bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      if (vkCreateBuffer(_device, &bufferInfo, nullptr, &_buffer) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create staging buffer!");
+      }
+
+      VkMemoryRequirements memRequirements;
+      vkGetBufferMemoryRequirements(_device, _buffer, &memRequirements);
+      _allocation = _allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      vkBindBufferMemory(_device, _buffer, _allocation.memory, _allocation.offset);
+   }
+
+   StagingRing::~StagingRing() {
+      vkDestroyBuffer(_device, _buffer, nullptr);
+      _allocator.free(_allocation);
+   }
+
+   bool StagingRing::allocate(VkDeviceSize size, Region& region) {
+      constexpr VkDeviceSize alignment = 16;
+
+      std::lock_guard lock{_mutex};
+
+      VkDeviceSize begin = 0;
+      if (!_inFlight.empty()) {
+         const VkDeviceSize head = _inFlight.back().end;
+         const VkDeviceSize tail = _inFlight.front().begin;
+
+         begin = alignUp(head, alignment);
+         if (head > tail) {
+            // live data is [tail, head), free space is [head, capacity) and [0, tail)
+            if (begin + size > _capacity) begin = 0;
+            if (begin == 0 && size > tail) return false;
+         } else if (begin + size > tail) {
+            // wrapped around, free space is [head, tail)
+            return false;
+         }
+      }
+      if (begin + size > _capacity) return false;
+
+      _inFlight.push_back({begin, begin + size, _nextTicket, false});
+
+      region.buffer = _buffer;
+      region.offset = begin;
+      region.mapped = static_cast<std::byte*>(_allocation.mapped) + begin;
+      region.ticket = _nextTicket++;
+      return true;
+   }
+
+   void StagingRing::release(uint64_t ticket) {
+      std::lock_guard lock{_mutex};
+
+      for (auto& region : _inFlight) {
+         if (region.ticket == ticket) {
+            region.released = true;
+            break;
+         }
+      }
+      while (!_inFlight.empty() && _inFlight.front().released) _inFlight.pop_front();
+   }
+} // namespace gears
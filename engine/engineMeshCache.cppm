@@ -0,0 +1,275 @@
+module;
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <format>
+#include <random>
+#include <string>
+#include <optional>
+#include <fstream>
+#include <ios>
+#include <filesystem>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include "engineUtils.hpp"
+
+export module engine.meshCache;
+import engine.logger;
+
+namespace gears {
+
+   // read only mapping of a whole file, if the file can't be mapped isOpen() returns false
+   export class MappedFile {
+   public:
+      MappedFile(const std::string& filepath);
+      ~MappedFile();
+
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      MappedFile(MappedFile&& other) noexcept : _data{std::exchange(other._data, nullptr)}, _size{std::exchange(other._size, 0)} {}
+      MappedFile& operator=(MappedFile&& other) noexcept;
+
+      bool isOpen() const { return _data != nullptr; }
+      const std::byte* data() const { return _data; }
+      size_t size() const { return _size; }
+
+   private:
+      void _unmap();
+
+      const std::byte* _data = nullptr;
+      size_t _size = 0;
+   };
+
+   // binary mesh format written next to the source asset (<source>.grsmesh):
+   // header | deduplicated vertex blob | index blob, both blobs 16 byte aligned
+   export class MeshCache {
+   public:
+      static constexpr uint32_t MAGIC = 0x4d535247; // "GRSM"
+      // bumped whenever the layout or what the importer produces changes, older caches get reimported.
+      // 2: uvs read through the texcoord index, vertices deduplicated by the parallel importer
+      static constexpr uint32_t VERSION = 2;
+
+      struct Header {
+         uint32_t magic;
+         uint32_t version;
+         uint32_t vertexStride;
+         uint32_t vertexCount;
+         uint32_t indexCount;
+         uint32_t reserved;
+         uint64_t sourceSize;
+         int64_t sourceTime;
+         uint64_t sourceHash;
+         uint64_t vertexOffset;
+         uint64_t indexOffset;
+      };
+
+      // the data pointers stay valid for as long as the Mesh is alive
+      class Mesh {
+      public:
+         const void* vertexData() const { return _file.data() + _header.vertexOffset; }
+         uint32_t vertexCount() const { return _header.vertexCount; }
+         const uint32_t* indexData() const { return reinterpret_cast<const uint32_t*>(_file.data() + _header.indexOffset); }
+         uint32_t indexCount() const { return _header.indexCount; }
+
+      private:
+         friend class MeshCache;
+         Mesh(MappedFile&& file, const Header& header) : _file{std::move(file)}, _header{header} {}
+
+         MappedFile _file;
+         Header _header;
+      };
+
+      static std::string cachePath(const std::string& sourcePath) { return sourcePath + ".grsmesh"; }
+
+      // returns std::nullopt if there's no cache for sourcePath or if it's out of date
+      static std::optional<Mesh> load(const std::string& sourcePath, uint32_t vertexStride);
+      static void write(const std::string& sourcePath, uint32_t vertexStride, const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+
+   private:
+      static constexpr uint64_t ALIGNMENT = 16;
+
+      // std::nullopt if the file can't be mapped, which includes empty files
+      static std::optional<uint64_t> _hashFile(const std::string& filepath);
+      static bool _isValid(const Header& header, size_t fileSize);
+      static void _refreshSourceTime(const std::string& path, int64_t sourceTime);
+      static uint64_t _alignOffset(uint64_t offset) { return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+   };
+
+   // ========================================== implementation ==========================================
+
+#if defined(_WIN32)
+   MappedFile::MappedFile(const std::string& filepath) {
+      // shared for writing so the mesh cache can refresh the header of a file that is mapped
+      HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE) return;
+
+      LARGE_INTEGER size{};
+      if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+         HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+         if (mapping) {
+            _data = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (_data) _size = static_cast<size_t>(size.QuadPart);
+            CloseHandle(mapping); // the view keeps its own reference to the mapping
+         }
+      }
+      CloseHandle(file);
+   }
+
+   void MappedFile::_unmap() {
+      if (_data) UnmapViewOfFile(_data);
+   }
+#else
+   MappedFile::MappedFile(const std::string& filepath) {
+      int file = open(filepath.c_str(), O_RDONLY);
+      if (file < 0) return;
+
+      struct stat info{};
+      if (fstat(file, &info) == 0 && info.st_size > 0) {
+         void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+         if (mapping != MAP_FAILED) {
+            _data = static_cast<const std::byte*>(mapping);
+            _size = static_cast<size_t>(info.st_size);
+         }
+      }
+      close(file); // the mapping keeps its own reference to the file
+   }
+
+   void MappedFile::_unmap() {
+      if (_data) munmap(const_cast<std::byte*>(_data), _size);
+   }
+#endif // defined(_WIN32)
+
+   MappedFile::~MappedFile() { _unmap(); }
+
+   MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+      if (this != &other) {
+         _unmap();
+         _data = std::exchange(other._data, nullptr);
+         _size = std::exchange(other._size, 0);
+      }
+      return *this;
+   }
+
+   std::optional<uint64_t> MeshCache::_hashFile(const std::string& filepath) {
+      MappedFile file{filepath};
+      if (!file.isOpen()) return std::nullopt;
+      return hashBytes(file.data(), file.size());
+   }
+
+   bool MeshCache::_isValid(const Header& header, size_t fileSize) {
+      // the offsets come from the file, the blobs have to be aligned, in order and inside of it before any
+      // pointer into the mapping is handed out. compared against what's left of the file so nothing overflows
+      const uint64_t vertexBytes = uint64_t{header.vertexCount} * header.vertexStride;
+      const uint64_t indexBytes = uint64_t{header.indexCount} * sizeof(uint32_t);
+      return header.vertexOffset >= sizeof(Header) && header.vertexOffset % ALIGNMENT == 0 &&
+             header.indexOffset % ALIGNMENT == 0 &&
+             header.vertexOffset <= fileSize && vertexBytes <= fileSize - header.vertexOffset &&
+             header.indexOffset >= header.vertexOffset + vertexBytes &&
+             header.indexOffset <= fileSize && indexBytes <= fileSize - header.indexOffset;
+   }
+
+   void MeshCache::_refreshSourceTime(const std::string& path, int64_t sourceTime) {
+      // only this field changes, a reader seeing the old value just hashes the source once more
+      std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(offsetof(Header, sourceTime));
+      file.write(reinterpret_cast<const char*>(&sourceTime), sizeof(sourceTime));
+      if (!file) logger->logTrace("failed to refresh the source time of \"{}\"", path);
+   }
+
+   std::optional<MeshCache::Mesh> MeshCache::load(const std::string& sourcePath, uint32_t vertexStride) {
+      std::error_code error;
+      const auto sourceSize = std::filesystem::file_size(sourcePath, error);
+      if (error) return std::nullopt;
+      const auto sourceTime = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+      if (error) return std::nullopt;
+
+      MappedFile file{cachePath(sourcePath)};
+      if (!file.isOpen() || file.size() < sizeof(Header)) return std::nullopt;
+
+      Header header;
+      memcpy(&header, file.data(), sizeof(Header));
+
+      if (header.magic != MAGIC || header.version != VERSION || header.vertexStride != vertexStride) {
+         logger->logTrace("mesh cache for \"{}\" has an incompatible format", sourcePath);
+         return std::nullopt;
+      }
+
+      if (!_isValid(header, file.size())) {
+         logger->warn("mesh cache for \"{}\" is truncated or corrupted", sourcePath);
+         return std::nullopt;
+      }
+
+      // the timestamp is only a shortcut, if it changed the source contents decide
+      bool upToDate = header.sourceSize == sourceSize;
+      if (upToDate && header.sourceTime != sourceTime) {
+         const auto sourceHash = _hashFile(sourcePath);
+         upToDate = sourceHash && *sourceHash == header.sourceHash;
+         // touched but unchanged, storing the new time keeps the next loads from hashing the source again
+         if (upToDate) _refreshSourceTime(cachePath(sourcePath), sourceTime);
+      }
+      if (!upToDate) {
+         logger->logTrace("mesh cache for \"{}\" is out of date", sourcePath);
+         return std::nullopt;
+      }
+
+      return Mesh{std::move(file), header};
+   }
+
+   void MeshCache::write(const std::string& sourcePath, uint32_t vertexStride, const void* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount) {
+      Header header{};
+      header.magic = MAGIC;
+      header.version = VERSION;
+      header.vertexStride = vertexStride;
+      header.vertexCount = vertexCount;
+      header.indexCount = indexCount;
+      header.sourceSize = std::filesystem::file_size(sourcePath);
+      header.sourceTime = std::filesystem::last_write_time(sourcePath).time_since_epoch().count();
+      const auto sourceHash = _hashFile(sourcePath);
+      if (!sourceHash) throw Logger::Exception("failed to open file: \"{}\"", sourcePath);
+      header.sourceHash = *sourceHash;
+      header.vertexOffset = _alignOffset(sizeof(Header));
+      header.indexOffset = _alignOffset(header.vertexOffset + uint64_t{vertexCount} * vertexStride);
+
+      // writing to a temporary file first so a crash never leaves a half written cache behind. the name is
+      // unique per writer, threads or processes converting the same source at once each rename a complete file
+      static std::atomic<uint32_t> writeCount{0};
+      const std::string path = cachePath(sourcePath);
+      const std::string tmpPath = std::format("{}.{:08x}{:08x}.tmp", path, std::random_device{}(), writeCount++);
+      std::error_code error;
+      {
+         std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+         if (!file) throw Logger::Exception("failed to open file: \"{}\"", tmpPath);
+
+         const char padding[16]{};
+         file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+         file.write(padding, static_cast<std::streamsize>(header.vertexOffset - sizeof(Header)));
+         file.write(static_cast<const char*>(vertices), static_cast<std::streamsize>(uint64_t{vertexCount} * vertexStride));
+         file.write(padding, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - uint64_t{vertexCount} * vertexStride));
+         file.write(reinterpret_cast<const char*>(indices), static_cast<std::streamsize>(uint64_t{indexCount} * sizeof(uint32_t)));
+
+         if (!file) {
+            file.close();
+            std::filesystem::remove(tmpPath, error);
+            throw Logger::Exception("failed to write file: \"{}\"", tmpPath);
+         }
+      }
+      std::filesystem::rename(tmpPath, path, error);
+      if (error) {
+         std::filesystem::remove(tmpPath, error);
+         throw Logger::Exception("failed to rename \"{}\" to \"{}\"", tmpPath, path);
+      }
+   }
+} // namespace gears
@@ -1,9 +1,15 @@
 module;
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <optional>
 
 #include <vulkan/vulkan.hpp>
 #define GLM_FORCE_RADIANS
@@ -20,6 +26,8 @@ module;
 export module engineModel;
 import engine.device;
 import engine.logger;
+import engine.meshCache;
+import engine.bounds;
 
 namespace gears {
 
@@ -43,33 +51,73 @@ namespace gears {
          std::vector<Vertex> vertices{};
          std::vector<uint32_t> indices{};
 
-         void loadModel(const std::string& filepath);
+         // threadCount 0 uses every hardware thread
+         void loadModel(const std::string& filepath, uint32_t threadCount = 0);
+         // single threaded std::unordered_map deduplication, what loadModel has to match exactly
+         void loadModelReference(const std::string& filepath);
+         void writeCache(const std::string& filepath) const;
+      };
+
+      // cpu side of a model file, backed by the mapped mesh cache when there's an up to date one
+      struct FileData {
+         std::optional<MeshCache::Mesh> mesh{};
+         Data data{};
+         // computed with the rest, so creating the model doesn't go over the vertices again
+         BoundingBox boundingBox{};
+         BoundingSphere boundingSphere{};
+
+         // doesn't touch the gpu, safe to call from worker threads. threadCount is passed to loadModel when
+         // there's no cache, callers already running on a pool should pass 1
+         static FileData load(const std::string& filepath, uint32_t threadCount = 0);
       };
 
       EngineModel(PhysicalDevice& device, const EngineModel::Data& data);
+      // records the uploads into batch, the model can't be drawn before the batch has completed
+      EngineModel(PhysicalDevice& device, const EngineModel::FileData& fileData, TransferBatch& batch);
       ~EngineModel();
 
       EngineModel(const EngineModel&) = delete;
       EngineModel& operator=(const EngineModel&) = delete;
 
       static std::unique_ptr<EngineModel> createModelFromFile(PhysicalDevice& device, const std::string& filepath);
+      // small grey cube drawn in place of models that are still streaming in
+      static std::unique_ptr<EngineModel> createPlaceholder(PhysicalDevice& device);
+      // parses filepath and writes its mesh cache without touching the gpu
+      static void convertModel(const std::string& filepath);
 
       void bind(VkCommandBuffer commandBuffer);
-      void draw(VkCommandBuffer commandBuffer);
+      void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+      // indirect commands always take INDIRECT_COMMAND_STRIDE bytes, models without an index buffer
+      // write a VkDrawIndirectCommand into the start of the slot
+      static constexpr VkDeviceSize INDIRECT_COMMAND_STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+      void writeIndirectCommand(void* dst, uint32_t instanceCount, uint32_t firstInstance) const;
+      void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+
+      // model space bounds of the vertices, computed when the model is loaded
+      const BoundingBox& getBoundingBox() const { return _boundingBox; }
+      const BoundingSphere& getBoundingSphere() const { return _boundingSphere; }
+
+      // bit i is set if one of the buffers was allocated from memory type i
+      uint32_t getMemoryTypeBits() const { return (1u << _vertexBufferMemory.memoryType) | (_hasIndexBuffer ? 1u << _indexBufferMemory.memoryType : 0u); }
 
    private:
+      static void _computeBounds(const Vertex* vertices, uint32_t vertexCount, BoundingBox& boundingBox, BoundingSphere& boundingSphere);
+
       PhysicalDevice& _device;
+      BoundingBox _boundingBox{};
+      BoundingSphere _boundingSphere{};
 
       VkBuffer _vertexBuffer;
-      VkDeviceMemory _vertexBufferMemory;
+      Allocation _vertexBufferMemory;
       uint32_t _vertexCount;
-      void _createVertexBuffers(const std::vector<Vertex>& vertices);
+      void _createVertexBuffers(const Vertex* vertices, uint32_t vertexCount, TransferBatch& batch);
 
       bool _hasIndexBuffer = false;
       VkBuffer _indexBuffer;
-      VkDeviceMemory _indexBufferMemory;
+      Allocation _indexBufferMemory;
       uint32_t _indexCount;
-      void _createIndexBuffer(const std::vector<uint32_t>& indices);
+      void _createIndexBuffer(const uint32_t* indices, uint32_t indexCount, TransferBatch& batch);
    };
 
 } // namespace gears
@@ -88,47 +136,99 @@ namespace std {
 namespace gears {
 
    EngineModel::EngineModel(PhysicalDevice& device, const EngineModel::Data& data) : _device(device) {
-      _createVertexBuffers(data.vertices);
-      _createIndexBuffer(data.indices);
+      _computeBounds(data.vertices.data(), static_cast<uint32_t>(data.vertices.size()), _boundingBox, _boundingSphere);
+
+      TransferBatch batch{_device};
+      _createVertexBuffers(data.vertices.data(), static_cast<uint32_t>(data.vertices.size()), batch);
+      _createIndexBuffer(data.indices.data(), static_cast<uint32_t>(data.indices.size()), batch);
+      batch.submit();
+      batch.wait();
+   }
+
+   EngineModel::EngineModel(PhysicalDevice& device, const EngineModel::FileData& fileData, TransferBatch& batch)
+       : _device(device), _boundingBox{fileData.boundingBox}, _boundingSphere{fileData.boundingSphere} {
+      if (fileData.mesh) {
+         _createVertexBuffers(static_cast<const Vertex*>(fileData.mesh->vertexData()), fileData.mesh->vertexCount(), batch);
+         _createIndexBuffer(fileData.mesh->indexData(), fileData.mesh->indexCount(), batch);
+      } else {
+         _createVertexBuffers(fileData.data.vertices.data(), static_cast<uint32_t>(fileData.data.vertices.size()), batch);
+         _createIndexBuffer(fileData.data.indices.data(), static_cast<uint32_t>(fileData.data.indices.size()), batch);
+      }
    }
 
    EngineModel::~EngineModel() {
-      vkDestroyBuffer(_device.device(), _vertexBuffer, nullptr);
-      vkFreeMemory(_device.device(), _vertexBufferMemory, nullptr);
+      _device.destroyBuffer(_vertexBuffer, _vertexBufferMemory);
 
-      if (_hasIndexBuffer) {
-         vkDestroyBuffer(_device.device(), _indexBuffer, nullptr);
-         vkFreeMemory(_device.device(), _indexBufferMemory, nullptr);
+      if (_hasIndexBuffer) _device.destroyBuffer(_indexBuffer, _indexBufferMemory);
+   }
+
+   EngineModel::FileData EngineModel::FileData::load(const std::string& filepath, uint32_t threadCount) {
+      FileData fileData{};
+
+      fileData.mesh = MeshCache::load(filepath, sizeof(Vertex));
+      if (fileData.mesh) {
+         logger->logTrace("vertex count: {} (mesh cache)", fileData.mesh->vertexCount());
+         _computeBounds(static_cast<const Vertex*>(fileData.mesh->vertexData()), fileData.mesh->vertexCount(), fileData.boundingBox, fileData.boundingSphere);
+         return fileData;
       }
+
+      fileData.data.loadModel(filepath, threadCount);
+      logger->logTrace("vertex count: {}", fileData.data.vertices.size());
+      _computeBounds(fileData.data.vertices.data(), static_cast<uint32_t>(fileData.data.vertices.size()), fileData.boundingBox, fileData.boundingSphere);
+
+      try {
+         fileData.data.writeCache(filepath);
+      } catch (const std::exception& e) {
+         logger->warn("failed to write the mesh cache for \"{}\": {}", filepath, e.what());
+      }
+
+      return fileData;
    }
 
    std::unique_ptr<EngineModel> EngineModel::createModelFromFile(PhysicalDevice& device, const std::string& filepath) {
-      Data data{};
-      data.loadModel(filepath);
-      logger->logTrace("vertex count: {}", data.vertices.size());
-      return std::make_unique<EngineModel>(device, data);
+      FileData fileData = FileData::load(filepath);
+
+      TransferBatch batch{device};
+      auto model = std::make_unique<EngineModel>(device, fileData, batch);
+      batch.submit();
+      batch.wait();
+
+      return model;
    }
 
-   void EngineModel::_createVertexBuffers(const std::vector<Vertex>& vertices) {
-      _vertexCount = static_cast<uint32_t>(vertices.size());
-      GRS_LOG_ASSERT(_vertexCount >= 3, "Vertex count must be at least 3");
+   std::unique_ptr<EngineModel> EngineModel::createPlaceholder(PhysicalDevice& device) {
+      Data data{};
+      for (int i = 0; i < 8; i++) {
+         Vertex vertex{};
+         vertex.position = {i & 1 ? .1f : -.1f, i & 2 ? .1f : -.1f, i & 4 ? .1f : -.1f};
+         vertex.color = {.5f, .5f, .5f};
+         vertex.normal = glm::normalize(vertex.position);
+         data.vertices.push_back(vertex);
+      }
+      data.indices = {
+          0, 1, 3, 0, 3, 2, // -z
+          4, 6, 7, 4, 7, 5, // +z
+          0, 4, 5, 0, 5, 1, // -y
+          2, 3, 7, 2, 7, 6, // +y
+          0, 2, 6, 0, 6, 4, // -x
+          1, 5, 7, 1, 7, 3, // +x
+      };
 
-      VkDeviceSize bufferSize = sizeof(vertices[0]) * _vertexCount;
+      return std::make_unique<EngineModel>(device, data);
+   }
 
-      VkBuffer stagingBuffer;
-      VkDeviceMemory stagingBufferMemory;
+   void EngineModel::convertModel(const std::string& filepath) {
+      Data data{};
+      data.loadModel(filepath);
+      data.writeCache(filepath);
+      logger->log("converted \"{}\" to \"{}\"", filepath, MeshCache::cachePath(filepath));
+   }
 
-      _device.createBuffer(
-          bufferSize,
-          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-          stagingBuffer,
-          stagingBufferMemory);
+   void EngineModel::_createVertexBuffers(const Vertex* vertices, uint32_t vertexCount, TransferBatch& batch) {
+      _vertexCount = vertexCount;
+      GRS_LOG_ASSERT(_vertexCount >= 3, "Vertex count must be at least 3");
 
-      void* data;
-      vkMapMemory(_device.device(), stagingBufferMemory, 0, bufferSize, 0, &data);
-      memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-      vkUnmapMemory(_device.device(), stagingBufferMemory);
+      VkDeviceSize bufferSize = sizeof(Vertex) * _vertexCount;
 
       _device.createBuffer(
           bufferSize,
@@ -137,33 +237,29 @@ namespace gears {
           _vertexBuffer,
           _vertexBufferMemory);
 
-      _device.copyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
+      batch.upload(_vertexBuffer, vertices, bufferSize);
+   }
+
+   void EngineModel::_computeBounds(const Vertex* vertices, uint32_t vertexCount, BoundingBox& boundingBox, BoundingSphere& boundingSphere) {
+      boundingBox = {};
+      for (uint32_t i = 0; i < vertexCount; i++) boundingBox.expand(vertices[i].position);
 
-      vkDestroyBuffer(_device.device(), stagingBuffer, nullptr);
-      vkFreeMemory(_device.device(), stagingBufferMemory, nullptr);
+      // centered on the box, tighter than the sphere around the box for most meshes
+      boundingSphere.center = boundingBox.center();
+      float radiusSquared = 0.f;
+      for (uint32_t i = 0; i < vertexCount; i++) {
+         const glm::vec3 offset = vertices[i].position - boundingSphere.center;
+         radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+      }
+      boundingSphere.radius = std::sqrt(radiusSquared);
    }
 
-   void EngineModel::_createIndexBuffer(const std::vector<uint32_t>& indices) {
-      _indexCount = static_cast<uint32_t>(indices.size());
+   void EngineModel::_createIndexBuffer(const uint32_t* indices, uint32_t indexCount, TransferBatch& batch) {
+      _indexCount = indexCount;
       _hasIndexBuffer = _indexCount > 0;
       if (!_hasIndexBuffer) return;
 
-      VkDeviceSize bufferSize = sizeof(indices[0]) * _indexCount;
-
-      VkBuffer stagingBuffer;
-      VkDeviceMemory stagingBufferMemory;
-
-      _device.createBuffer(
-          bufferSize,
-          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-          stagingBuffer,
-          stagingBufferMemory);
-
-      void* data;
-      vkMapMemory(_device.device(), stagingBufferMemory, 0, bufferSize, 0, &data);
-      memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
-      vkUnmapMemory(_device.device(), stagingBufferMemory);
+      VkDeviceSize bufferSize = sizeof(uint32_t) * _indexCount;
 
       _device.createBuffer(
           bufferSize,
@@ -172,16 +268,29 @@ namespace gears {
           _indexBuffer,
           _indexBufferMemory);
 
-      _device.copyBuffer(stagingBuffer, _indexBuffer, bufferSize);
+      batch.upload(_indexBuffer, indices, bufferSize);
+   }
 
-      vkDestroyBuffer(_device.device(), stagingBuffer, nullptr);
-      vkFreeMemory(_device.device(), stagingBufferMemory, nullptr);
+   void EngineModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+      if (_hasIndexBuffer) vkCmdDrawIndexed(commandBuffer, _indexCount, instanceCount, 0, 0, firstInstance);
+      else
+         vkCmdDraw(commandBuffer, _vertexCount, instanceCount, 0, firstInstance);
    }
 
-   void EngineModel::draw(VkCommandBuffer commandBuffer) {
-      if (_hasIndexBuffer) vkCmdDrawIndexed(commandBuffer, _indexCount, 1, 0, 0, 0);
+   void EngineModel::writeIndirectCommand(void* dst, uint32_t instanceCount, uint32_t firstInstance) const {
+      if (_hasIndexBuffer) {
+         VkDrawIndexedIndirectCommand command{_indexCount, instanceCount, 0, 0, firstInstance};
+         memcpy(dst, &command, sizeof(command));
+      } else {
+         VkDrawIndirectCommand command{_vertexCount, instanceCount, 0, firstInstance};
+         memcpy(dst, &command, sizeof(command));
+      }
+   }
+
+   void EngineModel::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
+      if (_hasIndexBuffer) vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, 1, static_cast<uint32_t>(INDIRECT_COMMAND_STRIDE));
       else
-         vkCmdDraw(commandBuffer, _vertexCount, 1, 0, 0);
+         vkCmdDrawIndirect(commandBuffer, buffer, offset, 1, static_cast<uint32_t>(INDIRECT_COMMAND_STRIDE));
    }
 
    void EngineModel::bind(VkCommandBuffer commandBuffer) {
@@ -212,7 +321,108 @@ namespace gears {
       return attributeDescriptions;
    }
 
-   void EngineModel::Data::loadModel(const std::string& filepath) {
+   void EngineModel::Data::writeCache(const std::string& filepath) const {
+      MeshCache::write(filepath, sizeof(Vertex), vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()));
+   }
+
+   // open addressing (linear probing) table mapping vertices to their index in an external vertex array,
+   // lookup and insertion are a single probe sequence
+   class VertexTable {
+   public:
+      VertexTable(size_t expectedCount) {
+         size_t capacity = 16;
+         while (capacity < expectedCount * 2) capacity <<= 1;
+         _slots.assign(capacity, Slot{});
+      }
+
+      // returns the index of an equal vertex if there's one, otherwise stores newIndex and returns it
+      std::pair<uint32_t, bool> findOrInsert(const EngineModel::Vertex* vertices, const EngineModel::Vertex& vertex, uint32_t hash, uint32_t newIndex) {
+         if ((_count + 1) * 2 > _slots.size()) _grow();
+
+         const size_t mask = _slots.size() - 1;
+         for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = _slots[i];
+            if (slot.index == EMPTY) {
+               slot = {hash, newIndex};
+               _count++;
+               return {newIndex, true};
+            }
+            if (slot.hash == hash && vertices[slot.index] == vertex) return {slot.index, false};
+         }
+      }
+
+   private:
+      static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+      struct Slot {
+         uint32_t hash = 0;
+         uint32_t index = EMPTY;
+      };
+
+      void _grow() {
+         std::vector<Slot> old = std::move(_slots);
+         _slots.assign(old.size() * 2, Slot{});
+
+         const size_t mask = _slots.size() - 1;
+         for (const Slot& slot : old) {
+            if (slot.index == EMPTY) continue;
+            size_t i = slot.hash & mask;
+            while (_slots[i].index != EMPTY) i = (i + 1) & mask;
+            _slots[i] = slot;
+         }
+      }
+
+      std::vector<Slot> _slots;
+      size_t _count = 0;
+   };
+
+   uint32_t hashVertex(const EngineModel::Vertex& vertex) {
+      static_assert(sizeof(EngineModel::Vertex) == 11 * sizeof(float), "Vertex must be tightly packed floats");
+
+      float components[11];
+      memcpy(components, &vertex, sizeof(components));
+
+      uint64_t hash = 0;
+      for (float component : components) {
+         // adding +0 folds -0 into +0, they compare equal so they must hash equal
+         hash = (hash ^ std::bit_cast<uint32_t>(component + 0.0f)) * 0x9e3779b97f4a7c15ull;
+         hash ^= hash >> 29;
+      }
+      return static_cast<uint32_t>(hash ^ (hash >> 32));
+   }
+
+   EngineModel::Vertex makeVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index) {
+      EngineModel::Vertex vertex{};
+
+      if (index.vertex_index >= 0) {
+         vertex.position = {
+             attrib.vertices[3 * index.vertex_index + 0],
+             attrib.vertices[3 * index.vertex_index + 1],
+             attrib.vertices[3 * index.vertex_index + 2]};
+
+         vertex.color = {
+             attrib.colors[3 * index.vertex_index + 0],
+             attrib.colors[3 * index.vertex_index + 2],
+             attrib.colors[3 * index.vertex_index + 1]};
+      }
+
+      if (index.normal_index >= 0) {
+         vertex.normal = {
+             attrib.normals[3 * index.normal_index + 0],
+             attrib.normals[3 * index.normal_index + 1],
+             attrib.normals[3 * index.normal_index + 2]};
+      }
+
+      if (index.texcoord_index >= 0) {
+         vertex.uv = {
+             attrib.texcoords[2 * index.texcoord_index + 0],
+             attrib.texcoords[2 * index.texcoord_index + 1]};
+      }
+
+      return vertex;
+   }
+
+   void EngineModel::Data::loadModelReference(const std::string& filepath) {
       tinyobj::attrib_t attrib;
       std::vector<tinyobj::shape_t> shapes;
       std::vector<tinyobj::material_t> materials;
@@ -224,42 +434,99 @@ namespace gears {
       indices.clear();
 
       std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
       for (const auto& shape : shapes) {
          for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
-
-            if (index.vertex_index >= 0) {
-               vertex.position = {
-                   attrib.vertices[3 * index.vertex_index + 0],
-                   attrib.vertices[3 * index.vertex_index + 1],
-                   attrib.vertices[3 * index.vertex_index + 2]};
-
-               vertex.color = {
-                   attrib.colors[3 * index.vertex_index + 0],
-                   attrib.colors[3 * index.vertex_index + 2],
-                   attrib.colors[3 * index.vertex_index + 1]};
-            }
+            Vertex vertex = makeVertex(attrib, index);
+            auto [it, inserted] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+            if (inserted) vertices.push_back(vertex);
+            indices.push_back(it->second);
+         }
+      }
+   }
 
-            if (index.normal_index >= 0) {
-               vertex.normal = {
-                   attrib.normals[3 * index.normal_index + 0],
-                   attrib.normals[3 * index.normal_index + 1],
-                   attrib.normals[3 * index.normal_index + 2]};
-            }
+   // runs func(0..count-1), func(0) on the calling thread and the rest on their own threads
+   template <typename Func>
+   void parallelFor(size_t count, Func&& func) {
+      std::vector<std::jthread> workers;
+      workers.reserve(count);
+      for (size_t i = 1; i < count; i++) workers.emplace_back(func, i);
+      func(0);
+   }
 
-            if (index.normal_index >= 0) {
-               vertex.uv = {
-                   attrib.texcoords[2 * index.texcoord_index + 0],
-                   attrib.texcoords[2 * index.texcoord_index + 1]};
-            }
+   void EngineModel::Data::loadModel(const std::string& filepath, uint32_t threadCount) {
+      tinyobj::attrib_t attrib;
+      std::vector<tinyobj::shape_t> shapes;
+      std::vector<tinyobj::material_t> materials;
+      std::string warn, err;
+
+      if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) throw Logger::Exception("{}{}", warn, err);
+
+      vertices.clear();
+      indices.clear();
 
-            if (uniqueVertices.count(vertex) == 0) {
-               uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-               vertices.push_back(vertex);
+      std::vector<tinyobj::index_t> corners;
+      for (const auto& shape : shapes) corners.insert(corners.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+
+      // every chunk is deduplicated on its own, then the chunks are merged in order so the result is
+      // identical to deduplicating the whole index stream on a single thread
+      constexpr size_t MIN_CORNERS_PER_THREAD = 4096;
+      if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+      const size_t chunkCount = std::clamp<size_t>(corners.size() / MIN_CORNERS_PER_THREAD, 1, threadCount);
+
+      struct Chunk {
+         size_t begin;
+         size_t end;
+         std::vector<Vertex> vertices;
+         std::vector<uint32_t> hashes;
+         std::vector<uint32_t> indices;
+         std::vector<uint32_t> remap;
+      };
+      std::vector<Chunk> chunks(chunkCount);
+
+      parallelFor(chunkCount, [&](size_t c) {
+         Chunk& chunk = chunks[c];
+         chunk.begin = corners.size() * c / chunkCount;
+         chunk.end = corners.size() * (c + 1) / chunkCount;
+         chunk.indices.reserve(chunk.end - chunk.begin);
+
+         VertexTable table{(chunk.end - chunk.begin) / 2};
+         for (size_t i = chunk.begin; i < chunk.end; i++) {
+            Vertex vertex = makeVertex(attrib, corners[i]);
+            uint32_t hash = hashVertex(vertex);
+
+            auto [index, inserted] = table.findOrInsert(chunk.vertices.data(), vertex, hash, static_cast<uint32_t>(chunk.vertices.size()));
+            if (inserted) {
+               chunk.vertices.push_back(vertex);
+               chunk.hashes.push_back(hash);
             }
-            indices.push_back(uniqueVertices[vertex]);
+            chunk.indices.push_back(index);
+         }
+      });
+
+      if (chunkCount == 1) {
+         vertices = std::move(chunks[0].vertices);
+         indices = std::move(chunks[0].indices);
+         return;
+      }
+
+      size_t localVertexCount = 0;
+      for (const auto& chunk : chunks) localVertexCount += chunk.vertices.size();
+      vertices.reserve(localVertexCount);
+
+      VertexTable table{localVertexCount};
+      for (auto& chunk : chunks) {
+         chunk.remap.resize(chunk.vertices.size());
+         for (size_t i = 0; i < chunk.vertices.size(); i++) {
+            auto [index, inserted] = table.findOrInsert(vertices.data(), chunk.vertices[i], chunk.hashes[i], static_cast<uint32_t>(vertices.size()));
+            if (inserted) vertices.push_back(chunk.vertices[i]);
+            chunk.remap[i] = index;
          }
       }
+
+      indices.resize(corners.size());
+      parallelFor(chunkCount, [&](size_t c) {
+         const Chunk& chunk = chunks[c];
+         for (size_t i = 0; i < chunk.indices.size(); i++) indices[chunk.begin + i] = chunk.remap[chunk.indices[i]];
+      });
    }
 } // namespace gears
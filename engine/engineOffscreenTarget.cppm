@@ -0,0 +1,240 @@
+module;
+
+#include <array>
+
+#include <vulkan/vulkan.hpp>
+
+export module engine.offscreenTarget;
+import engine.device;
+import engine.commandPools;
+import engine.logger;
+
+namespace gears {
+
+   // color + depth render target that isn't backed by a swap chain, used for headless rendering
+   export class OffscreenTarget {
+   public:
+      OffscreenTarget(PhysicalDevice& device, VkExtent2D extent, VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM);
+      ~OffscreenTarget();
+
+      OffscreenTarget(const OffscreenTarget&) = delete;
+      OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+      VkRenderPass getRenderPass() const { return _renderPass; }
+      VkExtent2D getExtent() const { return _extent; }
+      VkFormat getColorFormat() const { return _colorFormat; }
+      // left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL at the end of the render pass
+      VkImage getColorImage() const { return _colorImage; }
+      RenderPassContext getRenderPassContext() const { return {_renderPass, _framebuffer, _extent}; }
+
+      // with secondary contents the viewport and scissor are left to the secondary command buffers
+      void beginRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+      void endRenderPass(VkCommandBuffer commandBuffer);
+
+   private:
+      void _createImages();
+      void _createRenderPass();
+      void _createFramebuffer();
+
+      PhysicalDevice& _device;
+      VkExtent2D _extent;
+      VkFormat _colorFormat;
+      VkFormat _depthFormat;
+
+      VkImage _colorImage;
+      Allocation _colorImageMemory;
+      VkImageView _colorImageView;
+      VkImage _depthImage;
+      Allocation _depthImageMemory;
+      VkImageView _depthImageView;
+
+      VkRenderPass _renderPass;
+      VkFramebuffer _framebuffer;
+   };
+
+   // ========================================== implementation ==========================================
+
+   OffscreenTarget::OffscreenTarget(PhysicalDevice& device, VkExtent2D extent, VkFormat colorFormat)
+       : _device{device}, _extent{extent}, _colorFormat{colorFormat} {
+      _depthFormat = _device.findSupportedFormat(
+          {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+          VK_IMAGE_TILING_OPTIMAL,
+          VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+      _createImages();
+      _createRenderPass();
+      _createFramebuffer();
+   }
+
+   OffscreenTarget::~OffscreenTarget() {
+      vkDestroyFramebuffer(_device.device(), _framebuffer, nullptr);
+      vkDestroyRenderPass(_device.device(), _renderPass, nullptr);
+
+      vkDestroyImageView(_device.device(), _colorImageView, nullptr);
+      _device.destroyImage(_colorImage, _colorImageMemory);
+      vkDestroyImageView(_device.device(), _depthImageView, nullptr);
+      _device.destroyImage(_depthImage, _depthImageMemory);
+   }
+
+   void OffscreenTarget::_createImages() {
+      VkImageCreateInfo imageInfo{};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.extent.width = _extent.width;
+      imageInfo.extent.height = _extent.height;
+      imageInfo.extent.depth = 1;
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      imageInfo.format = _colorFormat;
+      imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+      _device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorImage, _colorImageMemory);
+
+      imageInfo.format = _depthFormat;
+      imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+      _device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
+
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.subresourceRange.baseMipLevel = 0;
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      viewInfo.image = _colorImage;
+      viewInfo.format = _colorFormat;
+      viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      if (vkCreateImageView(_device.device(), &viewInfo, nullptr, &_colorImageView) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create offscreen color image view!");
+      }
+
+      viewInfo.image = _depthImage;
+      viewInfo.format = _depthFormat;
+      viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+      if (vkCreateImageView(_device.device(), &viewInfo, nullptr, &_depthImageView) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create offscreen depth image view!");
+      }
+   }
+
+   void OffscreenTarget::_createRenderPass() {
+      VkAttachmentDescription depthAttachment{};
+      depthAttachment.format = _depthFormat;
+      depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+      VkAttachmentReference depthAttachmentRef{};
+      depthAttachmentRef.attachment = 1;
+      depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+      VkAttachmentDescription colorAttachment = {};
+      colorAttachment.format = _colorFormat;
+      colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+      colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+      colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+      VkAttachmentReference colorAttachmentRef = {};
+      colorAttachmentRef.attachment = 0;
+      colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+      VkSubpassDescription subpass = {};
+      subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      subpass.colorAttachmentCount = 1;
+      subpass.pColorAttachments = &colorAttachmentRef;
+      subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+      std::array<VkSubpassDependency, 2> dependencies{};
+      dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+      dependencies[0].dstSubpass = 0;
+      dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+      dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+      dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+      // the color image is read back with transfer commands after the pass
+      dependencies[1].srcSubpass = 0;
+      dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+      dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+      dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+      std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+      VkRenderPassCreateInfo renderPassInfo = {};
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+      renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+      renderPassInfo.pAttachments = attachments.data();
+      renderPassInfo.subpassCount = 1;
+      renderPassInfo.pSubpasses = &subpass;
+      renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+      renderPassInfo.pDependencies = dependencies.data();
+
+      if (vkCreateRenderPass(_device.device(), &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create offscreen render pass!");
+      }
+   }
+
+   void OffscreenTarget::_createFramebuffer() {
+      std::array<VkImageView, 2> attachments = {_colorImageView, _depthImageView};
+
+      VkFramebufferCreateInfo framebufferInfo = {};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = _renderPass;
+      framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+      framebufferInfo.pAttachments = attachments.data();
+      framebufferInfo.width = _extent.width;
+      framebufferInfo.height = _extent.height;
+      framebufferInfo.layers = 1;
+
+      if (vkCreateFramebuffer(_device.device(), &framebufferInfo, nullptr, &_framebuffer) != VK_SUCCESS) {
+         throw Logger::Exception("failed to create offscreen framebuffer!");
+      }
+   }
+
+   void OffscreenTarget::beginRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+      VkRenderPassBeginInfo renderPassInfo{};
+      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderPassInfo.renderPass = _renderPass;
+      renderPassInfo.framebuffer = _framebuffer;
+      renderPassInfo.renderArea.offset = {0, 0};
+      renderPassInfo.renderArea.extent = _extent;
+
+      std::array<VkClearValue, 2> clearValues{};
+      clearValues[0].color = {0.01f, 0.01f, 0.01f, 1.0f};
+      clearValues[1].depthStencil = {1.0f, 0};
+
+      renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+      renderPassInfo.pClearValues = clearValues.data();
+
+      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+      if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) return;
+
+      VkViewport viewport{};
+      viewport.x = 0.0f;
+      viewport.y = 0.0f;
+      viewport.width = static_cast<float>(_extent.width);
+      viewport.height = static_cast<float>(_extent.height);
+      viewport.minDepth = 0.0f;
+      viewport.maxDepth = 1.0f;
+      VkRect2D scissor{{0, 0}, _extent};
+      vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+   }
+
+   void OffscreenTarget::endRenderPass(VkCommandBuffer commandBuffer) {
+      vkCmdEndRenderPass(commandBuffer);
+   }
+} // namespace gears
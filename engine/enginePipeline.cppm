@@ -7,6 +7,7 @@ module;
 #include <vulkan/vulkan.hpp>
 
 #include "macro.hpp"
+#include "engineUtils.hpp"
 
 export module enginePipeline;
 import engineModel;
@@ -34,9 +35,11 @@ namespace gears {
       uint32_t subpass = 0;
    };
 
+   // the shader modules aren't owned by the pipeline and can be destroyed once it's created, pipelines are
+   // normally created through a PipelineRegistry which shares the modules and the pipeline cache
    export class EnginePipeline {
    public:
-      EnginePipeline(PhysicalDevice& device, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo);
+      EnginePipeline(PhysicalDevice& device, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
       ~EnginePipeline();
 
       EnginePipeline(const EnginePipeline&) = delete;
@@ -45,17 +48,15 @@ namespace gears {
       void bind(VkCommandBuffer VkCommandBuffer);
 
       static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
-
-   private:
+      // hash of every state in configInfo that affects the created pipeline, pointers are followed instead of hashed
+      static uint64_t hashConfigInfo(const PipelineConfigInfo& configInfo);
       static std::vector<char> readFile(const std::string& filePath);
-      void createGraphicsPipeline(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo);
 
-      void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+   private:
+      void createGraphicsPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo, VkPipelineCache pipelineCache);
 
       PhysicalDevice& _device;
       VkPipeline _graphicsPipeline;
-      VkShaderModule _vertShaderModule;
-      VkShaderModule _fragShaderModule;
    };
 
    //  ========================================== implementation ==========================================
@@ -77,29 +78,24 @@ namespace gears {
 
 
    void EnginePipeline::createGraphicsPipeline(
-       const std::string& vertFilepath,
-       const std::string& fragFilepath,
-       const PipelineConfigInfo& configInfo) {
+       VkShaderModule vertShaderModule,
+       VkShaderModule fragShaderModule,
+       const PipelineConfigInfo& configInfo,
+       VkPipelineCache pipelineCache) {
       GRS_LOG_ASSERT(configInfo.pipelineLayout != VK_NULL_HANDLE, "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
       GRS_LOG_ASSERT(configInfo.renderPass != VK_NULL_HANDLE, "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-      auto vertCode = readFile(vertFilepath);
-      auto fragCode = readFile(fragFilepath);
-
-      createShaderModule(vertCode, &_vertShaderModule);
-      createShaderModule(fragCode, &_fragShaderModule);
-
       VkPipelineShaderStageCreateInfo shaderStages[2];
       shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
       shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-      shaderStages[0].module = _vertShaderModule;
+      shaderStages[0].module = vertShaderModule;
       shaderStages[0].pName = "main";
       shaderStages[0].flags = 0;
       shaderStages[0].pNext = nullptr;
       shaderStages[0].pSpecializationInfo = nullptr;
       shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
       shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-      shaderStages[1].module = _fragShaderModule;
+      shaderStages[1].module = fragShaderModule;
       shaderStages[1].pName = "main";
       shaderStages[1].flags = 0;
       shaderStages[1].pNext = nullptr;
@@ -135,26 +131,70 @@ namespace gears {
       pipelineInfo.basePipelineIndex = -1;
       pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-      if (vkCreateGraphicsPipelines(_device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) throw Logger::Exception("failed to create graphics pipeline");
+      if (vkCreateGraphicsPipelines(_device.device(), pipelineCache, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) throw Logger::Exception("failed to create graphics pipeline");
    }
 
-   EnginePipeline::EnginePipeline(PhysicalDevice& device, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo) : _device(device) {
-      createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
+   EnginePipeline::EnginePipeline(PhysicalDevice& device, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo, VkPipelineCache pipelineCache) : _device(device) {
+      createGraphicsPipeline(vertShaderModule, fragShaderModule, configInfo, pipelineCache);
    }
 
    EnginePipeline::~EnginePipeline() {
-      vkDestroyShaderModule(_device.device(), _vertShaderModule, nullptr);
-      vkDestroyShaderModule(_device.device(), _fragShaderModule, nullptr);
       vkDestroyPipeline(_device.device(), _graphicsPipeline, nullptr);
    }
 
-   void EnginePipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
-      VkShaderModuleCreateInfo createInfo{};
-      createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-      createInfo.codeSize = code.size();
-      createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-      if (vkCreateShaderModule(_device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) throw Logger::Exception("failed to create shader moudule");
+   uint64_t EnginePipeline::hashConfigInfo(const PipelineConfigInfo& configInfo) {
+      // field by field, the structs contain pointers (pNext, pAttachments, ...) and padding
+      uint64_t hash = hashBytes(nullptr, 0);
+      auto add = [&hash](const auto& value) { hash = hashBytes(&value, sizeof(value), hash); };
+
+      add(configInfo.viewportInfo.viewportCount);
+      add(configInfo.viewportInfo.scissorCount);
+
+      add(configInfo.inputAssemblyInfo.topology);
+      add(configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+      const auto& rasterization = configInfo.rasterizationInfo;
+      add(rasterization.depthClampEnable);
+      add(rasterization.rasterizerDiscardEnable);
+      add(rasterization.polygonMode);
+      add(rasterization.cullMode);
+      add(rasterization.frontFace);
+      add(rasterization.depthBiasEnable);
+      add(rasterization.depthBiasConstantFactor);
+      add(rasterization.depthBiasClamp);
+      add(rasterization.depthBiasSlopeFactor);
+      add(rasterization.lineWidth);
+
+      const auto& multisample = configInfo.multisampleInfo;
+      add(multisample.rasterizationSamples);
+      add(multisample.sampleShadingEnable);
+      add(multisample.minSampleShading);
+      add(multisample.alphaToCoverageEnable);
+      add(multisample.alphaToOneEnable);
+      if (multisample.pSampleMask) add(*multisample.pSampleMask);
+
+      add(configInfo.colorBlendInfo.logicOpEnable);
+      add(configInfo.colorBlendInfo.logicOp);
+      add(configInfo.colorBlendInfo.blendConstants);
+      for (uint32_t i = 0; i < configInfo.colorBlendInfo.attachmentCount; i++) add(configInfo.colorBlendInfo.pAttachments[i]);
+
+      const auto& depthStencil = configInfo.depthStencilInfo;
+      add(depthStencil.depthTestEnable);
+      add(depthStencil.depthWriteEnable);
+      add(depthStencil.depthCompareOp);
+      add(depthStencil.depthBoundsTestEnable);
+      add(depthStencil.stencilTestEnable);
+      add(depthStencil.front);
+      add(depthStencil.back);
+      add(depthStencil.minDepthBounds);
+      add(depthStencil.maxDepthBounds);
+
+      for (uint32_t i = 0; i < configInfo.dynamicStateInfo.dynamicStateCount; i++) add(configInfo.dynamicStateInfo.pDynamicStates[i]);
+
+      add(configInfo.pipelineLayout);
+      add(configInfo.renderPass);
+      add(configInfo.subpass);
+      return hash;
    }
 
    void EnginePipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
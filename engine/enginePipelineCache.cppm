@@ -0,0 +1,310 @@
+module;
+
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "engineUtils.hpp"
+
+export module engine.pipelineCache;
+import engine.device;
+import engine.logger;
+import enginePipeline;
+
+namespace gears {
+
+   // VkPipelineCache loaded from path and written back when destroyed. the data is discarded when it was
+   // saved by a different device or driver (its header doesn't match the device's pipelineCacheUUID) or
+   // when it's corrupted, the driver then starts from an empty cache
+   export class PipelineCache {
+   public:
+      PipelineCache(PhysicalDevice& device, std::string path);
+      ~PipelineCache();
+
+      PipelineCache(const PipelineCache&) = delete;
+      PipelineCache& operator=(const PipelineCache&) = delete;
+
+      VkPipelineCache handle() const { return _pipelineCache; }
+      // false when the cache started empty
+      bool isWarm() const { return _warm; }
+
+      // writes the cache to a temporary file first, so a crash never leaves a half written cache behind
+      void save();
+
+   private:
+      // in front of the driver's data, which is only handed to the driver if it matches
+      struct Header {
+         uint32_t magic;
+         uint32_t version;
+         uint64_t dataSize;
+         uint64_t dataHash;
+      };
+      static constexpr uint32_t MAGIC = 0x50535247; // "GRSP"
+      static constexpr uint32_t VERSION = 1;
+
+      std::vector<char> _load();
+      bool _isCompatible(const std::vector<char>& data) const;
+
+      PhysicalDevice& _device;
+      std::string _path;
+      VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+      bool _warm = false;
+   };
+
+   // one VkShaderModule per distinct spir-v, files with the same content share their module. every file is
+   // only read once, a registry doesn't see changes made to it on disk afterwards
+   export class ShaderModuleRegistry {
+   public:
+      ShaderModuleRegistry(PhysicalDevice& device) : _device{device} {}
+      ~ShaderModuleRegistry();
+
+      ShaderModuleRegistry(const ShaderModuleRegistry&) = delete;
+      ShaderModuleRegistry& operator=(const ShaderModuleRegistry&) = delete;
+
+      // returns the module and sets codeHash to the hash of the spir-v, which identifies the module
+      VkShaderModule get(const std::vector<char>& code, uint64_t& codeHash);
+      VkShaderModule getFile(const std::string& filePath, uint64_t& codeHash);
+
+      size_t size() const { return _modules.size(); }
+
+   private:
+      struct Module {
+         VkShaderModule module;
+         std::vector<char> code; // guards against hash collisions
+      };
+
+      struct File {
+         VkShaderModule module;
+         uint64_t codeHash;
+      };
+
+      PhysicalDevice& _device;
+      std::unordered_map<uint64_t, Module> _modules;
+      std::unordered_map<std::string, File> _files;
+   };
+
+   // creates pipelines through the persistent cache and hands out the same pipeline for the same shaders
+   // and configuration. pipelines stay alive as long as the registry, or until releaseUnused().
+   // the configuration is keyed on the render pass and pipeline layout handles, which the driver reuses for
+   // new objects once they're destroyed, so their owners have to release them from the registry first
+   export class PipelineRegistry {
+   public:
+      static constexpr const char* DEFAULT_CACHE_PATH = "pipelines.grscache";
+
+      PipelineRegistry(PhysicalDevice& device, std::string cachePath = DEFAULT_CACHE_PATH);
+      ~PipelineRegistry();
+
+      PipelineRegistry(const PipelineRegistry&) = delete;
+      PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+      std::shared_ptr<EnginePipeline> get(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo);
+      // destroys the pipelines nobody else holds, the caller makes sure the gpu isn't using them anymore
+      void releaseUnused();
+      // forgets the pipelines created with renderPass or pipelineLayout before it gets destroyed, the ones
+      // already handed out stay valid
+      void releaseRenderPass(VkRenderPass renderPass);
+      void releasePipelineLayout(VkPipelineLayout pipelineLayout);
+
+      PipelineCache& pipelineCache() { return _pipelineCache; }
+      ShaderModuleRegistry& shaderModules() { return _shaderModules; }
+      size_t size() const { return _pipelines.size(); }
+
+   private:
+      // what the key was hashed from, guards against hash collisions
+      struct Entry {
+         std::shared_ptr<EnginePipeline> pipeline;
+         uint64_t configHash;
+         uint64_t vertHash;
+         uint64_t fragHash;
+         VkRenderPass renderPass;
+         VkPipelineLayout pipelineLayout;
+         uint32_t subpass;
+      };
+
+      PhysicalDevice& _device;
+      PipelineCache _pipelineCache;
+      ShaderModuleRegistry _shaderModules;
+      std::unordered_map<uint64_t, Entry> _pipelines;
+   };
+
+   //  ========================================== implementation ==========================================
+
+   PipelineCache::PipelineCache(PhysicalDevice& device, std::string path) : _device{device}, _path{std::move(path)} {
+      std::vector<char> data = _load();
+      _warm = !data.empty();
+
+      VkPipelineCacheCreateInfo cacheInfo{};
+      cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+      cacheInfo.initialDataSize = data.size();
+      cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+      if (vkCreatePipelineCache(_device.device(), &cacheInfo, nullptr, &_pipelineCache) != VK_SUCCESS) throw Logger::Exception("failed to create pipeline cache");
+   }
+
+   PipelineCache::~PipelineCache() {
+      try {
+         save();
+      } catch (const std::exception& e) {
+         // losing the cache only costs startup time next run
+         logger->warn("failed to save pipeline cache \"{}\": {}", _path, e.what());
+      }
+      vkDestroyPipelineCache(_device.device(), _pipelineCache, nullptr);
+   }
+
+   std::vector<char> PipelineCache::_load() {
+      std::ifstream file(_path, std::ios::binary);
+      if (!file) {
+         logger->logTrace("no pipeline cache at \"{}\", starting cold", _path);
+         return {};
+      }
+
+      Header header{};
+      if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)) || header.magic != MAGIC || header.version != VERSION) {
+         logger->logTrace("pipeline cache \"{}\" has an incompatible format", _path);
+         return {};
+      }
+
+      if (header.dataSize > std::filesystem::file_size(_path) - sizeof(Header)) {
+         logger->warn("pipeline cache \"{}\" is truncated", _path);
+         return {};
+      }
+      std::vector<char> data(header.dataSize);
+      if (!file.read(data.data(), static_cast<std::streamsize>(data.size())) || hashBytes(data.data(), data.size()) != header.dataHash) {
+         logger->warn("pipeline cache \"{}\" is corrupted", _path);
+         return {};
+      }
+
+      if (!_isCompatible(data)) {
+         logger->logTrace("pipeline cache \"{}\" was saved by another device or driver", _path);
+         return {};
+      }
+      return data;
+   }
+
+   bool PipelineCache::_isCompatible(const std::vector<char>& data) const {
+      VkPipelineCacheHeaderVersionOne header{};
+      if (data.size() < sizeof(header)) return false;
+      memcpy(&header, data.data(), sizeof(header));
+
+      return header.headerSize >= sizeof(header) &&
+             header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+             header.vendorID == _device.properties.vendorID &&
+             header.deviceID == _device.properties.deviceID &&
+             memcmp(header.pipelineCacheUUID, _device.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+   }
+
+   void PipelineCache::save() {
+      size_t size = 0;
+      if (vkGetPipelineCacheData(_device.device(), _pipelineCache, &size, nullptr) != VK_SUCCESS) throw Logger::Exception("failed to get pipeline cache size");
+      std::vector<char> data(size);
+      // the cache can't grow in between, nothing else creates pipelines with it while saving
+      if (vkGetPipelineCacheData(_device.device(), _pipelineCache, &size, data.data()) != VK_SUCCESS) throw Logger::Exception("failed to get pipeline cache data");
+      data.resize(size);
+
+      Header header{};
+      header.magic = MAGIC;
+      header.version = VERSION;
+      header.dataSize = data.size();
+      header.dataHash = hashBytes(data.data(), data.size());
+
+      const std::string tmpPath = _path + ".tmp";
+      {
+         std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+         if (!file) throw Logger::Exception("failed to open file: \"{}\"", tmpPath);
+
+         file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+         file.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+         if (!file) throw Logger::Exception("failed to write file: \"{}\"", tmpPath);
+      }
+      std::filesystem::rename(tmpPath, _path);
+      logger->logTrace("saved {} bytes of pipeline cache to \"{}\"", data.size(), _path);
+   }
+
+   ShaderModuleRegistry::~ShaderModuleRegistry() {
+      for (auto& [hash, module] : _modules) vkDestroyShaderModule(_device.device(), module.module, nullptr);
+   }
+
+   VkShaderModule ShaderModuleRegistry::get(const std::vector<char>& code, uint64_t& codeHash) {
+      codeHash = hashBytes(code.data(), code.size());
+      if (auto it = _modules.find(codeHash); it != _modules.end()) {
+         if (it->second.code != code) throw Logger::Exception("shader code hash collision ({:016x})", codeHash);
+         return it->second.module;
+      }
+
+      VkShaderModuleCreateInfo createInfo{};
+      createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+      createInfo.codeSize = code.size();
+      createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+      VkShaderModule module;
+      if (vkCreateShaderModule(_device.device(), &createInfo, nullptr, &module) != VK_SUCCESS) throw Logger::Exception("failed to create shader module");
+      _modules.emplace(codeHash, Module{module, code});
+      return module;
+   }
+
+   VkShaderModule ShaderModuleRegistry::getFile(const std::string& filePath, uint64_t& codeHash) {
+      if (auto it = _files.find(filePath); it != _files.end()) {
+         codeHash = it->second.codeHash;
+         return it->second.module;
+      }
+
+      VkShaderModule module = get(EnginePipeline::readFile(filePath), codeHash);
+      _files.emplace(filePath, File{module, codeHash});
+      return module;
+   }
+
+   PipelineRegistry::PipelineRegistry(PhysicalDevice& device, std::string cachePath) : _device{device}, _pipelineCache{device, std::move(cachePath)}, _shaderModules{device} {}
+
+   PipelineRegistry::~PipelineRegistry() {
+      // destroyed before the cache gets saved, so nothing can still be adding to it
+      _pipelines.clear();
+   }
+
+   std::shared_ptr<EnginePipeline> PipelineRegistry::get(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo) {
+      uint64_t vertHash;
+      uint64_t fragHash;
+      VkShaderModule vertShaderModule = _shaderModules.getFile(vertFilePath, vertHash);
+      VkShaderModule fragShaderModule = _shaderModules.getFile(fragFilePath, fragHash);
+
+      const uint64_t configHash = EnginePipeline::hashConfigInfo(configInfo);
+      uint64_t key = hashBytes(&vertHash, sizeof(vertHash), configHash);
+      key = hashBytes(&fragHash, sizeof(fragHash), key);
+      if (auto it = _pipelines.find(key); it != _pipelines.end()) {
+         const Entry& entry = it->second;
+         if (entry.configHash != configHash || entry.vertHash != vertHash || entry.fragHash != fragHash ||
+             entry.renderPass != configInfo.renderPass || entry.pipelineLayout != configInfo.pipelineLayout || entry.subpass != configInfo.subpass) {
+            throw Logger::Exception("pipeline key hash collision ({:016x})", key);
+         }
+         return entry.pipeline;
+      }
+
+      auto start = std::chrono::high_resolution_clock::now();
+      auto pipeline = std::make_shared<EnginePipeline>(_device, vertShaderModule, fragShaderModule, configInfo, _pipelineCache.handle());
+      auto end = std::chrono::high_resolution_clock::now();
+      logger->logTrace("created pipeline for \"{}\" and \"{}\" in {:.2f} ms ({} cache)",
+                       vertFilePath, fragFilePath, std::chrono::duration<float, std::milli>(end - start).count(), _pipelineCache.isWarm() ? "warm" : "cold");
+
+      _pipelines.emplace(key, Entry{pipeline, configHash, vertHash, fragHash, configInfo.renderPass, configInfo.pipelineLayout, configInfo.subpass});
+      return pipeline;
+   }
+
+   void PipelineRegistry::releaseUnused() {
+      std::erase_if(_pipelines, [](const auto& entry) { return entry.second.pipeline.use_count() == 1; });
+   }
+
+   void PipelineRegistry::releaseRenderPass(VkRenderPass renderPass) {
+      std::erase_if(_pipelines, [renderPass](const auto& entry) { return entry.second.renderPass == renderPass; });
+   }
+
+   void PipelineRegistry::releasePipelineLayout(VkPipelineLayout pipelineLayout) {
+      std::erase_if(_pipelines, [pipelineLayout](const auto& entry) { return entry.second.pipelineLayout == pipelineLayout; });
+   }
+} // namespace gears
@@ -0,0 +1,257 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+export module engine.profiler;
+import engine.logger;
+
+namespace gears {
+
+   // collects named cpu scopes from any thread, gpu scopes read back by a GpuProfiler and frame times, keeps
+   // rolling percentiles of the frame times and exports everything as a chrome trace (chrome://tracing, perfetto).
+   // disabled profilers cost a relaxed atomic load per scope
+   export class Profiler {
+   public:
+      // events kept per thread, older ones are overwritten
+      static constexpr uint32_t RING_CAPACITY = 1 << 16;
+      // frames the percentiles are computed over
+      static constexpr uint32_t STATISTICS_WINDOW = 1024;
+
+      // nanoseconds since the profiler was created
+      struct Event {
+         const char* name; // string literal, only the pointer is stored
+         int64_t start;
+         int64_t duration;
+      };
+
+      // milliseconds over the last frames of the window
+      struct Statistics {
+         uint32_t frames = 0;
+         float mean = 0.f;
+         float p50 = 0.f;
+         float p95 = 0.f;
+         float p99 = 0.f;
+         float max = 0.f;
+      };
+
+      Profiler();
+      ~Profiler();
+
+      Profiler(const Profiler&) = delete;
+      Profiler& operator=(const Profiler&) = delete;
+
+      void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+      bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+      int64_t now() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count(); }
+
+      // appends to the calling thread's ring buffer, only that thread writes to it
+      void record(const char* name, int64_t start, int64_t end);
+      // gpu scopes already converted to the cpu timeline, from the thread that reads the queries back
+      void recordGpu(const char* name, int64_t start, int64_t duration);
+
+      // cpu frame time is measured between these two
+      void beginFrame();
+      void endFrame();
+      void addGpuFrameTime(float milliseconds);
+
+      Statistics cpuFrameStatistics() const { return _computeStatistics(_cpuFrameTimes); }
+      Statistics gpuFrameStatistics() const { return _computeStatistics(_gpuFrameTimes); }
+      void logStatistics() const;
+
+      // the threads recording scopes must be idle, their rings are read without synchronization
+      void exportChromeTrace(const std::string& path) const;
+
+   private:
+      struct Ring {
+         uint32_t threadId;
+         std::unique_ptr<Event[]> events{new Event[RING_CAPACITY]};
+         std::atomic<uint64_t> written{0};
+
+         void push(const Event& event);
+      };
+
+      // rolling window of frame times
+      struct FrameTimes {
+         std::vector<float> milliseconds;
+         uint32_t next = 0;
+
+         void add(float value);
+      };
+
+      Ring& _threadRing();
+      static Statistics _computeStatistics(const FrameTimes& frameTimes);
+
+      std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+      uint64_t _generation; // tells rings of a destroyed profiler apart in the threads' caches
+      std::atomic<bool> _enabled{false};
+
+      mutable std::mutex _ringsMutex;
+      std::vector<std::unique_ptr<Ring>> _rings;
+      Ring _gpuRing{};
+
+      int64_t _frameStart = 0;
+      FrameTimes _cpuFrameTimes;
+      FrameTimes _gpuFrameTimes;
+   };
+
+   // set by the profiler's constructor, scopes do nothing while it's null or disabled
+   export inline Profiler* profiler = nullptr;
+
+   // records the time between its construction and destruction as name on the current thread
+   export class ProfileScope {
+   public:
+      ProfileScope(const char* name) {
+         if (profiler && profiler->isEnabled()) {
+            _name = name;
+            _start = profiler->now();
+         }
+      }
+      ~ProfileScope() {
+         if (_name && profiler) profiler->record(_name, _start, profiler->now());
+      }
+
+      ProfileScope(const ProfileScope&) = delete;
+      ProfileScope& operator=(const ProfileScope&) = delete;
+
+   private:
+      const char* _name = nullptr;
+      int64_t _start = 0;
+   };
+
+   //  ========================================== implementation ==========================================
+
+   std::atomic<uint64_t> profilerGeneration{0};
+
+   struct ThreadRingCache {
+      uint64_t generation = 0;
+      void* ring = nullptr;
+   };
+   thread_local ThreadRingCache threadRingCache{};
+
+   Profiler::Profiler() : _generation{++profilerGeneration} {
+      _gpuRing.threadId = 0;
+      profiler = this;
+   }
+
+   Profiler::~Profiler() {
+      if (profiler == this) profiler = nullptr;
+   }
+
+   void Profiler::Ring::push(const Event& event) {
+      const uint64_t index = written.load(std::memory_order_relaxed);
+      events[index % RING_CAPACITY] = event;
+      written.store(index + 1, std::memory_order_release);
+   }
+
+   Profiler::Ring& Profiler::_threadRing() {
+      if (threadRingCache.generation == _generation) return *static_cast<Ring*>(threadRingCache.ring);
+
+      std::lock_guard lock{_ringsMutex};
+      auto& ring = _rings.emplace_back(std::make_unique<Ring>());
+      ring->threadId = static_cast<uint32_t>(_rings.size()); // 0 is the gpu
+      threadRingCache = {_generation, ring.get()};
+      return *ring;
+   }
+
+   void Profiler::record(const char* name, int64_t start, int64_t end) {
+      _threadRing().push({name, start, end - start});
+   }
+
+   void Profiler::recordGpu(const char* name, int64_t start, int64_t duration) {
+      _gpuRing.push({name, start, duration});
+   }
+
+   void Profiler::beginFrame() {
+      _frameStart = now();
+   }
+
+   void Profiler::endFrame() {
+      const int64_t end = now();
+      if (isEnabled()) record("frame", _frameStart, end);
+      _cpuFrameTimes.add(static_cast<float>(end - _frameStart) / 1e6f);
+   }
+
+   void Profiler::addGpuFrameTime(float milliseconds) {
+      _gpuFrameTimes.add(milliseconds);
+   }
+
+   void Profiler::FrameTimes::add(float value) {
+      if (milliseconds.size() < STATISTICS_WINDOW) {
+         milliseconds.push_back(value);
+         return;
+      }
+      milliseconds[next] = value;
+      next = (next + 1) % STATISTICS_WINDOW;
+   }
+
+   Profiler::Statistics Profiler::_computeStatistics(const FrameTimes& frameTimes) {
+      Statistics statistics{};
+      if (frameTimes.milliseconds.empty()) return statistics;
+
+      std::vector<float> sorted = frameTimes.milliseconds;
+      std::sort(sorted.begin(), sorted.end());
+      // nearest rank
+      auto percentile = [&](float p) { return sorted[static_cast<size_t>(std::max(1.f, std::ceil(p * static_cast<float>(sorted.size())))) - 1]; };
+
+      statistics.frames = static_cast<uint32_t>(sorted.size());
+      for (float value : sorted) statistics.mean += value;
+      statistics.mean /= static_cast<float>(sorted.size());
+      statistics.p50 = percentile(.50f);
+      statistics.p95 = percentile(.95f);
+      statistics.p99 = percentile(.99f);
+      statistics.max = sorted.back();
+      return statistics;
+   }
+
+   void Profiler::logStatistics() const {
+      const auto cpu = cpuFrameStatistics();
+      logger->log("cpu frame over {} frames: mean {:.3f} ms, p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms", cpu.frames, cpu.mean, cpu.p50, cpu.p95, cpu.p99, cpu.max);
+
+      const auto gpu = gpuFrameStatistics();
+      if (gpu.frames == 0) return;
+      logger->log("gpu frame over {} frames: mean {:.3f} ms, p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms", gpu.frames, gpu.mean, gpu.p50, gpu.p95, gpu.p99, gpu.max);
+   }
+
+   void Profiler::exportChromeTrace(const std::string& path) const {
+      std::ofstream file(path, std::ios::trunc);
+      if (!file) throw Logger::Exception("failed to open file: \"{}\"", path);
+
+      // complete ("X") events in microseconds, the gpu gets its own process so it shows up as a separate track
+      size_t eventCount = 0;
+      auto writeRing = [&](const Ring& ring, uint32_t pid) {
+         const uint64_t written = ring.written.load(std::memory_order_acquire);
+         const uint64_t first = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+         for (uint64_t i = first; i < written; i++) {
+            const Event& event = ring.events[i % RING_CAPACITY];
+            file << (eventCount++ ? ",\n" : "\n")
+                 << std::format(R"({{"name":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":{},"tid":{}}})",
+                                event.name, event.start / 1e3, event.duration / 1e3, pid, ring.threadId);
+         }
+      };
+
+      file << R"({"displayTimeUnit":"ms","traceEvents":[)";
+      file << "\n" << R"({"name":"process_name","ph":"M","pid":0,"args":{"name":"cpu"}},)";
+      file << "\n" << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"gpu"}})";
+      eventCount = 2;
+      {
+         std::lock_guard lock{_ringsMutex};
+         for (const auto& ring : _rings) writeRing(*ring, 0);
+      }
+      writeRing(_gpuRing, 1);
+      file << "\n]}\n";
+
+      if (!file) throw Logger::Exception("failed to write file: \"{}\"", path);
+      logger->log("wrote {} trace events to \"{}\"", eventCount - 2, path);
+   }
+} // namespace gears
@@ -1,6 +1,11 @@
 module;
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <vulkan/vulkan.hpp>
@@ -14,96 +19,425 @@ module;
 
 export module engine.renderSystem;
 import enginePipeline;
+import engine.pipelineCache;
 import engine.device;
 import engine.camera;
 import engine.logger;
 import engine.gameObject;
+import engine.swapChain;
+import engine.transformSystem;
+import engine.culling;
+import engine.commandPools;
+import engine.jobSystem;
+import engine.gpuProfiler;
+import engine.profiler;
+import engineModel;
 
 namespace gears {
 
+   struct SimplePushConstantData {
+      glm::mat4 projectionView{1.f};
+   };
+
+   // std430 layout of an element of the instance storage buffer in shader.vert
+   struct InstanceData {
+      glm::mat4 modelMatrix{1.f};
+      glm::mat4 normalMatrix{1.f};
+   };
+
+   // push constants of push_constant.vert, one set per draw
+   struct ReferencePushConstantData {
+      glm::mat4 transform{1.f};
+      glm::mat4 normalMatrix{1.f};
+   };
+
    export class EngineRenderSystem {
    public:
-      EngineRenderSystem(PhysicalDevice& device, VkRenderPass renderPass);
+      EngineRenderSystem(PhysicalDevice& device, PipelineRegistry& pipelines, VkRenderPass renderPass);
       ~EngineRenderSystem();
 
       EngineRenderSystem(const EngineRenderSystem&) = delete;
       EngineRenderSystem& operator=(const EngineRenderSystem&) = delete;
 
-      void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<EngineGameObject>& gameObjects, const EngineCamera& camera);
+      // objects drawn by one secondary command buffer are never fewer than this, smaller scenes use a single one
+      static constexpr uint32_t MIN_DRAWS_PER_SECONDARY = 256;
+
+      // frameIndex selects the per frame instance and indirect buffers and command pools, the previous submission
+      // that used them has to be complete. objects without an entry in transforms are skipped like objects without a model.
+      // without renderPass the draws are recorded inline into commandBuffer, otherwise the render pass has to be
+      // begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS and the draws are recorded into secondary
+      // command buffers, on the job system's threads when there is one, and executed from commandBuffer
+      void renderGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<EngineGameObject>& gameObjects, TransformSystem& transforms, const EngineCamera& camera, const RenderPassContext* renderPass = nullptr);
+
+      // optional, spreads culling and recording over its threads. waits for the device to be idle
+      void setJobSystem(JobSystem* jobSystem);
+      // optional, times the game object draws on the gpu
+      void setGpuProfiler(GpuProfiler* gpuProfiler) { _gpuProfiler = gpuProfiler; }
+
+      // when disabled every object gets its own draw call with its matrices in push constants, the path
+      // from before instancing, kept around as the reference
+      void setBatching(bool enabled) { _batching = enabled; }
+      bool isBatching() const { return _batching; }
+
+      // objects outside the camera frustum are skipped when enabled
+      void setCulling(bool enabled) { _culling = enabled; }
+      bool isCulling() const { return _culling; }
+      CullingSystem& cullingSystem() { return _cullingSystem; }
 
    private:
-      void _createPipelineLayout();
-      void _createPipeline(VkRenderPass renderPass);
+      struct FrameResources {
+         VkBuffer instanceBuffer = VK_NULL_HANDLE;
+         Allocation instanceMemory{};
+         uint32_t instanceCapacity = 0;
+
+         VkBuffer indirectBuffer = VK_NULL_HANDLE;
+         Allocation indirectMemory{};
+         uint32_t indirectCapacity = 0;
+
+         VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+      };
+
+      struct DrawBatch {
+         EngineModel* model;
+         uint32_t firstInstance;
+         uint32_t instanceCount;
+      };
+
+      void _createDescriptorSetLayout();
+      void _createDescriptorSets();
+      void _createPipelineLayouts();
+      void _createPipelines(PipelineRegistry& pipelines, VkRenderPass renderPass);
+
+      void _reserveInstances(FrameResources& frame, uint32_t instanceCount);
+      void _reserveIndirectCommands(FrameResources& frame, uint32_t commandCount);
+      // groups the objects to draw by model into _batches and splits them into at most maxChunks chunks of
+      // consecutive instances. visible lists the indices of the objects to draw or is null to draw all of them
+      void _buildBatches(FrameResources& frame, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const std::vector<uint32_t>* visible, uint32_t maxChunks);
+      // writes the instance data of the batches in [begin, end) into frame, or into _referenceInstances without
+      // batching, binds the pipeline and records them
+      void _recordBatches(VkCommandBuffer commandBuffer, const FrameResources& frame, const SimplePushConstantData& push, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, uint32_t begin, uint32_t end);
+      void _recordSecondary(VkCommandBuffer commandBuffer, int frameIndex, const SimplePushConstantData& push, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const RenderPassContext& renderPass);
 
       PhysicalDevice& _device;
-      std::unique_ptr<EnginePipeline> _enginePipeline;
+      PipelineRegistry& _pipelineRegistry; // must outlive the render system
+      std::shared_ptr<EnginePipeline> _enginePipeline;
       VkPipelineLayout _pipelineLayout;
+      std::shared_ptr<EnginePipeline> _referencePipeline;
+      VkPipelineLayout _referencePipelineLayout;
+      VkDescriptorSetLayout _descriptorSetLayout;
+      VkDescriptorPool _descriptorPool;
+      std::array<FrameResources, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> _frames{};
+
+      bool _batching = true;
+      bool _culling = true;
+      CullingSystem _cullingSystem;
+      std::vector<std::pair<EngineModel*, uint32_t>> _sortedObjects; // reused every frame to avoid reallocations
+      std::vector<DrawBatch> _batches;
+      std::vector<uint32_t> _chunks; // first batch of every chunk followed by the batch count
+      std::vector<InstanceData> _referenceInstances;
+
+      JobSystem* _jobSystem = nullptr;
+      GpuProfiler* _gpuProfiler = nullptr;
+      std::unique_ptr<FrameCommandPools> _commandPools;
+      std::vector<VkCommandBuffer> _secondaryBuffers; // in execution order
    };
 
    //  ========================================== implementation ==========================================
 
-   struct SimplePushConstantData {
-      glm::mat4 transform{1.f};
-      glm::mat4 normalMatrix{1.f};
-   };
+   EngineRenderSystem::EngineRenderSystem(PhysicalDevice& device, PipelineRegistry& pipelines, VkRenderPass renderPass) : _device{device}, _pipelineRegistry{pipelines} {
+      _createDescriptorSetLayout();
+      _createDescriptorSets();
+      _createPipelineLayouts();
+      _createPipelines(pipelines, renderPass);
+      _commandPools = std::make_unique<FrameCommandPools>(_device, 1);
+   }
+
+   void EngineRenderSystem::setJobSystem(JobSystem* jobSystem) {
+      // the pools of frames still in flight can't be destroyed
+      vkDeviceWaitIdle(_device.device());
 
-   EngineRenderSystem::EngineRenderSystem(PhysicalDevice& device, VkRenderPass renderPass) : _device{device} {
-      _createPipelineLayout();
-      _createPipeline(renderPass);
+      _jobSystem = jobSystem;
+      _cullingSystem.setJobSystem(jobSystem);
+      _commandPools = std::make_unique<FrameCommandPools>(_device, jobSystem ? jobSystem->threadCount() : 1);
    }
 
    EngineRenderSystem::~EngineRenderSystem() {
+      for (auto& frame : _frames) {
+         if (frame.instanceBuffer != VK_NULL_HANDLE) _device.destroyBuffer(frame.instanceBuffer, frame.instanceMemory);
+         if (frame.indirectBuffer != VK_NULL_HANDLE) _device.destroyBuffer(frame.indirectBuffer, frame.indirectMemory);
+      }
+      vkDestroyDescriptorPool(_device.device(), _descriptorPool, nullptr);
+      _pipelineRegistry.releasePipelineLayout(_pipelineLayout);
+      _pipelineRegistry.releasePipelineLayout(_referencePipelineLayout);
       vkDestroyPipelineLayout(_device.device(), _pipelineLayout, nullptr);
+      vkDestroyPipelineLayout(_device.device(), _referencePipelineLayout, nullptr);
+      vkDestroyDescriptorSetLayout(_device.device(), _descriptorSetLayout, nullptr);
    }
 
-   void EngineRenderSystem::_createPipelineLayout() {
+   void EngineRenderSystem::_createDescriptorSetLayout() {
+      VkDescriptorSetLayoutBinding instanceBinding{};
+      instanceBinding.binding = 0;
+      instanceBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      instanceBinding.descriptorCount = 1;
+      instanceBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+      VkDescriptorSetLayoutCreateInfo layoutInfo{};
+      layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      layoutInfo.bindingCount = 1;
+      layoutInfo.pBindings = &instanceBinding;
+      if (vkCreateDescriptorSetLayout(_device.device(), &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) throw Logger::Exception("failed to create a descriptor set layout");
+   }
+
+   void EngineRenderSystem::_createDescriptorSets() {
+      VkDescriptorPoolSize poolSize{};
+      poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      poolSize.descriptorCount = static_cast<uint32_t>(_frames.size());
+
+      VkDescriptorPoolCreateInfo poolInfo{};
+      poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      poolInfo.maxSets = static_cast<uint32_t>(_frames.size());
+      poolInfo.poolSizeCount = 1;
+      poolInfo.pPoolSizes = &poolSize;
+      if (vkCreateDescriptorPool(_device.device(), &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) throw Logger::Exception("failed to create a descriptor pool");
+
+      std::array<VkDescriptorSetLayout, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> layouts;
+      layouts.fill(_descriptorSetLayout);
+      std::array<VkDescriptorSet, EngineSwapChain::MAX_FRAMES_IN_FLIGHT> sets;
+
+      VkDescriptorSetAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfo.descriptorPool = _descriptorPool;
+      allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+      allocInfo.pSetLayouts = layouts.data();
+      if (vkAllocateDescriptorSets(_device.device(), &allocInfo, sets.data()) != VK_SUCCESS) throw Logger::Exception("failed to allocate descriptor sets");
+
+      for (size_t i = 0; i < _frames.size(); i++) {
+         _frames[i].descriptorSet = sets[i];
+         // the descriptor has to point at a valid buffer before the first draw
+         _reserveInstances(_frames[i], 1);
+      }
+   }
+
+   void EngineRenderSystem::_createPipelineLayouts() {
       VkPushConstantRange pushConstantRange{};
-      pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+      pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
       pushConstantRange.offset = 0;
       pushConstantRange.size = sizeof(SimplePushConstantData);
 
       VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
       pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-      pipelineLayoutInfo.setLayoutCount = 0;
-      pipelineLayoutInfo.pSetLayouts = VK_NULL_HANDLE;
+      pipelineLayoutInfo.setLayoutCount = 1;
+      pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
       pipelineLayoutInfo.pushConstantRangeCount = 1;
       pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
       if (vkCreatePipelineLayout(_device.device(), &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) throw Logger::Exception("failed to create a pipeline layout");
+
+      pushConstantRange.size = sizeof(ReferencePushConstantData);
+      pipelineLayoutInfo.setLayoutCount = 0;
+      pipelineLayoutInfo.pSetLayouts = nullptr;
+      if (vkCreatePipelineLayout(_device.device(), &pipelineLayoutInfo, nullptr, &_referencePipelineLayout) != VK_SUCCESS) throw Logger::Exception("failed to create a pipeline layout");
    }
 
-   void EngineRenderSystem::_createPipeline(VkRenderPass renderPass) {
+   void EngineRenderSystem::_createPipelines(PipelineRegistry& pipelines, VkRenderPass renderPass) {
       GRS_LOG_ASSERT(_pipelineLayout != VK_NULL_HANDLE, "cannot create pipeline before pipeline layout");
 
       PipelineConfigInfo pipelineConfig{};
       EnginePipeline::defaultPipelineConfigInfo(pipelineConfig);
       pipelineConfig.renderPass = renderPass;
       pipelineConfig.pipelineLayout = _pipelineLayout;
-      _enginePipeline = std::make_unique<EnginePipeline>(_device, "shaders/shader.vert.spv", "shaders/shader.frag.spv", pipelineConfig);
+      _enginePipeline = pipelines.get("shaders/shader.vert.spv", "shaders/shader.frag.spv", pipelineConfig);
+
+      pipelineConfig.pipelineLayout = _referencePipelineLayout;
+      _referencePipeline = pipelines.get("shaders/push_constant.vert.spv", "shaders/shader.frag.spv", pipelineConfig);
    }
 
-   void EngineRenderSystem::renderGameObjects(VkCommandBuffer commandBuffer, std::vector<EngineGameObject>& gameObjects, const EngineCamera& camera) {
+   void EngineRenderSystem::_reserveInstances(FrameResources& frame, uint32_t instanceCount) {
+      if (instanceCount <= frame.instanceCapacity) return;
+
+      // the frame's previous submission is complete, so the old buffer can go right away
+      if (frame.instanceBuffer != VK_NULL_HANDLE) _device.destroyBuffer(frame.instanceBuffer, frame.instanceMemory);
+
+      frame.instanceCapacity = std::bit_ceil(instanceCount);
+      _device.createBuffer(
+          sizeof(InstanceData) * frame.instanceCapacity,
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          frame.instanceBuffer,
+          frame.instanceMemory);
+
+      VkDescriptorBufferInfo bufferInfo{};
+      bufferInfo.buffer = frame.instanceBuffer;
+      bufferInfo.offset = 0;
+      bufferInfo.range = VK_WHOLE_SIZE;
+
+      VkWriteDescriptorSet write{};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = frame.descriptorSet;
+      write.dstBinding = 0;
+      write.descriptorCount = 1;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write.pBufferInfo = &bufferInfo;
+      vkUpdateDescriptorSets(_device.device(), 1, &write, 0, nullptr);
+   }
+
+   void EngineRenderSystem::_reserveIndirectCommands(FrameResources& frame, uint32_t commandCount) {
+      if (commandCount <= frame.indirectCapacity) return;
+
+      if (frame.indirectBuffer != VK_NULL_HANDLE) _device.destroyBuffer(frame.indirectBuffer, frame.indirectMemory);
+
+      frame.indirectCapacity = std::bit_ceil(commandCount);
+      _device.createBuffer(
+          EngineModel::INDIRECT_COMMAND_STRIDE * frame.indirectCapacity,
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          frame.indirectBuffer,
+          frame.indirectMemory);
+   }
+
+   void EngineRenderSystem::_buildBatches(FrameResources& frame, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const std::vector<uint32_t>* visible, uint32_t maxChunks) {
+      _sortedObjects.clear();
+      _batches.clear();
+      _chunks.clear();
+      if (visible) {
+         for (uint32_t i : *visible) _sortedObjects.emplace_back(gameObjects[i].model.get(), i);
+      } else {
+         for (uint32_t i = 0; i < gameObjects.size(); i++) {
+            if (gameObjects[i].model && transforms.contains(gameObjects[i].getId())) _sortedObjects.emplace_back(gameObjects[i].model.get(), i);
+         }
+      }
+      if (_sortedObjects.empty()) return;
+
+      const uint32_t objectCount = static_cast<uint32_t>(_sortedObjects.size());
+      if (_batching) {
+         // objects sharing a model end up next to each other and keep their relative order
+         std::sort(_sortedObjects.begin(), _sortedObjects.end());
+         _reserveInstances(frame, objectCount);
+      } else {
+         // read back on the cpu for every draw, so they stay out of the host visible instance buffer
+         _referenceInstances.resize(objectCount);
+      }
+
+      // chunks are sized in objects, not batches: a batch crossing a chunk boundary is split in two so a
+      // model drawn by most of the scene still gets spread over the threads
+      const uint32_t chunkSize = std::max(MIN_DRAWS_PER_SECONDARY, (objectCount + maxChunks - 1) / maxChunks);
+      for (uint32_t i = 0; i < objectCount; i++) {
+         EngineModel* model = _sortedObjects[i].first;
+         const bool chunkStart = i % chunkSize == 0;
+         if (chunkStart) _chunks.push_back(static_cast<uint32_t>(_batches.size()));
+
+         if (_batching && !chunkStart && _batches.back().model == model) _batches.back().instanceCount++;
+         else
+            _batches.push_back({model, i, 1});
+      }
+      _chunks.push_back(static_cast<uint32_t>(_batches.size()));
+   }
+
+   void EngineRenderSystem::_recordBatches(VkCommandBuffer commandBuffer, const FrameResources& frame, const SimplePushConstantData& push, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, uint32_t begin, uint32_t end) {
+      if (begin == end) return;
+
+      // the instances of the batches are consecutive, every chunk writes its own range
+      const uint32_t firstInstance = _batches[begin].firstInstance;
+      const uint32_t endInstance = _batches[end - 1].firstInstance + _batches[end - 1].instanceCount;
+      auto* instances = _batching ? static_cast<InstanceData*>(frame.instanceMemory.mapped) : _referenceInstances.data();
+      for (uint32_t i = firstInstance; i < endInstance; i++) {
+         const auto id = gameObjects[_sortedObjects[i].second].getId();
+         memcpy(&instances[i].modelMatrix, &transforms.modelMatrix(id), sizeof(glm::mat4));
+         memcpy(&instances[i].normalMatrix, &transforms.normalMatrix(id), sizeof(glm::mat4));
+      }
+
+      if (!_batching) {
+         _referencePipeline->bind(commandBuffer);
+         for (uint32_t i = begin; i < end; i++) {
+            const auto& instance = _referenceInstances[_batches[i].firstInstance];
+            ReferencePushConstantData objectPush{};
+            objectPush.transform = push.projectionView * instance.modelMatrix;
+            objectPush.normalMatrix = instance.normalMatrix;
+
+            vkCmdPushConstants(commandBuffer, _referencePipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ReferencePushConstantData), &objectPush);
+            _batches[i].model->bind(commandBuffer);
+            _batches[i].model->draw(commandBuffer);
+         }
+         return;
+      }
+
       _enginePipeline->bind(commandBuffer);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+      vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(SimplePushConstantData), &push);
+
+      // the indirect buffer is written by the same thread that records the draws reading it
+      auto* commands = static_cast<std::byte*>(frame.indirectMemory.mapped);
+      for (uint32_t i = begin; i < end; i++) {
+         _batches[i].model->writeIndirectCommand(commands + i * EngineModel::INDIRECT_COMMAND_STRIDE, _batches[i].instanceCount, _batches[i].firstInstance);
+      }
+      for (uint32_t i = begin; i < end; i++) {
+         _batches[i].model->bind(commandBuffer);
+         _batches[i].model->drawIndirect(commandBuffer, frame.indirectBuffer, i * EngineModel::INDIRECT_COMMAND_STRIDE);
+      }
+   }
+
+   void EngineRenderSystem::_recordSecondary(VkCommandBuffer commandBuffer, int frameIndex, const SimplePushConstantData& push, std::vector<EngineGameObject>& gameObjects, const TransformSystem& transforms, const RenderPassContext& renderPass) {
+      const auto& frame = _frames[frameIndex];
+      _commandPools->reset(frameIndex);
+
+      // every chunk gets its own secondary command buffer and they're executed in chunk order so the draw
+      // order doesn't change
+      const uint32_t chunkCount = static_cast<uint32_t>(_chunks.size() - 1);
+      _secondaryBuffers.resize(chunkCount);
+
+      // the primary can't write timestamps inside the render pass, the first and last chunk do it
+      const uint32_t gpuScope = _gpuProfiler ? _gpuProfiler->addScope("game objects") : GpuProfiler::INVALID_SCOPE;
+
+      auto recordChunk = [&](uint32_t chunk) {
+         ProfileScope scope{"record secondary"};
+         VkCommandBuffer secondary = _commandPools->beginSecondary(frameIndex, JobSystem::threadIndex(), renderPass);
+         if (_gpuProfiler && chunk == 0) _gpuProfiler->writeBegin(secondary, gpuScope);
+         _recordBatches(secondary, frame, push, gameObjects, transforms, _chunks[chunk], _chunks[chunk + 1]);
+         if (_gpuProfiler && chunk == chunkCount - 1) _gpuProfiler->writeEnd(secondary, gpuScope);
+         if (vkEndCommandBuffer(secondary) != VK_SUCCESS) throw Logger::Exception("failed to record secondary command buffer");
+         _secondaryBuffers[chunk] = secondary;
+      };
+
+      if (_jobSystem && chunkCount > 1) {
+         _jobSystem->parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t chunk = begin; chunk < end; chunk++) recordChunk(chunk);
+         });
+      } else {
+         for (uint32_t chunk = 0; chunk < chunkCount; chunk++) recordChunk(chunk);
+      }
+
+      vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(_secondaryBuffers.size()), _secondaryBuffers.data());
+   }
+
+   void EngineRenderSystem::renderGameObjects(VkCommandBuffer commandBuffer, int frameIndex, std::vector<EngineGameObject>& gameObjects, TransformSystem& transforms, const EngineCamera& camera, const RenderPassContext* renderPass) {
+      GRS_LOG_ASSERT(frameIndex >= 0 && frameIndex < EngineSwapChain::MAX_FRAMES_IN_FLIGHT, "frame index out of range");
+      auto& frame = _frames[frameIndex];
+
+      SimplePushConstantData push{};
+      push.projectionView = camera.getProjection() * camera.getView();
+
+      {
+         ProfileScope scope{"update transforms"};
+         transforms.update();
+      }
+      const std::vector<uint32_t>* visible = nullptr;
+      if (_culling) {
+         ProfileScope scope{"culling"};
+         visible = &_cullingSystem.cull(gameObjects, transforms, push.projectionView);
+      }
+      {
+         ProfileScope scope{"build batches"};
+         // a couple of chunks per thread so threads that finish early can steal the rest
+         const uint32_t maxChunks = renderPass && _jobSystem ? _commandPools->threadCount() * 2 : 1;
+         _buildBatches(frame, gameObjects, transforms, visible, maxChunks);
+      }
+      if (_batches.empty()) return;
+      if (_batching) _reserveIndirectCommands(frame, static_cast<uint32_t>(_batches.size()));
 
-      auto projectionView = camera.getProjection() * camera.getView();
-
-      for (auto& obj : gameObjects) {
-         // obj.transform.rotation.y = glm::mod<float>(obj.transform.rotation.y + 0.01f, 2.0f * glm::pi<float>());
-         // obj.transform.rotation.x = glm::mod<float>(obj.transform.rotation.y + 0.001f, 2.0f * glm::pi<float>());
-
-         SimplePushConstantData push{};
-         auto modelMatrix = obj.transform.mat4();
-         push.transform = projectionView * modelMatrix;
-         push.normalMatrix = obj.transform.normalMatrix();
-
-         vkCmdPushConstants(
-             commandBuffer,
-             _pipelineLayout,
-             VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-             0,
-             sizeof(SimplePushConstantData),
-             &push);
-         obj.model->bind(commandBuffer);
-         obj.model->draw(commandBuffer);
+      ProfileScope scope{"record draws"};
+      if (renderPass) _recordSecondary(commandBuffer, frameIndex, push, gameObjects, transforms, *renderPass);
+      else {
+         GpuProfiler::Scope gpuScope{_gpuProfiler, commandBuffer, "game objects"};
+         _recordBatches(commandBuffer, frame, push, gameObjects, transforms, 0, static_cast<uint32_t>(_batches.size()));
       }
    }
-} // namespace gears
\ No newline at end of file
+} // namespace gears
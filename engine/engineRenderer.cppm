@@ -14,6 +14,10 @@ import engine.logger;
 import engine.window;
 import engine.device;
 import engine.swapChain;
+import engine.commandPools;
+import engine.gpuProfiler;
+import engine.pipelineCache;
+import engine.profiler;
 
 namespace gears {
 
@@ -30,11 +34,21 @@ namespace gears {
       float getAspectRatio() const { return _engineSwapChain->extentAspectRatio(); }
 
       VkRenderPass getSwapChainRenderPass() const { return _engineSwapChain->getRenderPass(); }
+      // render pass and framebuffer of the current frame, for secondary command buffers recorded inside it
+      RenderPassContext getSwapChainRenderPassContext() const {
+         GRS_LOG_ASSERT(_isFrameStarted, "cannot get render pass context when frame not in progress");
+         return {_engineSwapChain->getRenderPass(), _engineSwapChain->getFrameBuffer(_currentImageIndex), _engineSwapChain->getSwapChainExtent()};
+      }
       VkCommandBuffer getCurrentCommandBuffer() const {
          GRS_LOG_ASSERT(_isFrameStarted, "cannot get command buffer when frame not in progress");
          return _commandBuffers[_currentFrameIndex];
       }
 
+      // timestamps of the current frame, for the systems drawing into it
+      GpuProfiler& gpuProfiler() { return _gpuProfiler; }
+      // optional, releases the render pass of every swap chain that gets replaced from it
+      void setPipelineRegistry(PipelineRegistry* pipelines) { _pipelines = pipelines; }
+
       int getFrameIndex() const {
          GRS_LOG_ASSERT(_isFrameStarted, "cannot get frame index when frame not in progress");
          return _currentFrameIndex;
@@ -42,7 +56,8 @@ namespace gears {
 
       VkCommandBuffer beginFrame();
       void endFrame();
-      void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+      // with secondary contents every draw has to come from secondary command buffers, which set their own viewport and scissor
+      void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
       void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
       void enableVSync();
@@ -57,6 +72,9 @@ namespace gears {
       PhysicalDevice& _device;
       std::unique_ptr<EngineSwapChain> _engineSwapChain;
       std::vector<VkCommandBuffer> _commandBuffers;
+      GpuProfiler _gpuProfiler{_device};
+      PipelineRegistry* _pipelines = nullptr;
+      uint32_t _renderPassScope = GpuProfiler::INVALID_SCOPE;
 
       uint32_t _currentImageIndex;
       int _currentFrameIndex{0};
@@ -86,10 +104,13 @@ namespace gears {
          std::shared_ptr<EngineSwapChain> oldSwapChain = std::move(_engineSwapChain);
          _engineSwapChain = std::make_unique<EngineSwapChain>(_device, extent, oldSwapChain);
          if (!oldSwapChain->compareSwapFormats(*_engineSwapChain.get())) throw Logger::Exception("swapChain image format has changed");
+         // its handle can be reused by the next render pass the driver creates
+         if (_pipelines) _pipelines->releaseRenderPass(oldSwapChain->getRenderPass());
       }
 
-      // se renderpass compatibile non fare nulla
-      // createPipeline();
+      // the new render pass has the same formats, so it's compatible with the one the pipelines were created
+      // with and they keep working. a format change would need new pipelines, which the PipelineRegistry
+      // would mostly pull out of the pipeline cache
    }
 
    void Renderer::_createCommandBuffers() {
@@ -112,7 +133,11 @@ namespace gears {
    VkCommandBuffer Renderer::beginFrame() {
       GRS_LOG_ASSERT(!_isFrameStarted, "can't call beginFrame while already in progress");
 
-      auto result = _engineSwapChain->acquireNextImage(&_currentImageIndex);
+      VkResult result;
+      {
+         ProfileScope scope{"acquire image"}; // waits for the frame that last used this frame index
+         result = _engineSwapChain->acquireNextImage(&_currentImageIndex);
+      }
 
       if (result == VK_ERROR_OUT_OF_DATE_KHR) {
          _recreateSwapChain();
@@ -129,6 +154,7 @@ namespace gears {
       beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
       if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw Logger::Exception("failed to begin recording command buffer");
+      _gpuProfiler.beginFrame(commandBuffer, _currentFrameIndex);
 
       return commandBuffer;
    }
@@ -138,9 +164,14 @@ namespace gears {
 
       auto commandBuffer = getCurrentCommandBuffer();
 
+      _gpuProfiler.endFrame(commandBuffer);
       if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw Logger::Exception("failed to record command buffer");
 
-      auto result = _engineSwapChain->submitCommandBuffers(&commandBuffer, &_currentImageIndex);
+      VkResult result;
+      {
+         ProfileScope scope{"submit and present"};
+         result = _engineSwapChain->submitCommandBuffers(&commandBuffer, &_currentImageIndex);
+      }
       if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _window.wasWindowResized()) {
          _window.resetWindowResizeFlag();
          _recreateSwapChain();
@@ -151,7 +182,7 @@ namespace gears {
       _currentFrameIndex = (_currentFrameIndex + 1) % EngineSwapChain::MAX_FRAMES_IN_FLIGHT;
    }
 
-   void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+   void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
       GRS_LOG_ASSERT(_isFrameStarted, "can't call beginFrame while frame not in progress");
       GRS_LOG_ASSERT(commandBuffer == getCurrentCommandBuffer(), "can't begin renderPass on command buffer from diffrent frame");
 
@@ -173,7 +204,9 @@ namespace gears {
       renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
       renderPassInfo.pClearValues = clearValues.data();
 
-      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+      _renderPassScope = _gpuProfiler.beginScope(commandBuffer, "swap chain render pass");
+      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+      if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) return;
 
       VkViewport viewport{};
       viewport.x = 0.0f;
@@ -192,6 +225,8 @@ namespace gears {
       GRS_LOG_ASSERT(commandBuffer == getCurrentCommandBuffer(), "can't end renderPass on command buffer from diffrent frame");
 
       vkCmdEndRenderPass(commandBuffer);
+      _gpuProfiler.endScope(commandBuffer, _renderPassScope);
+      _renderPassScope = GpuProfiler::INVALID_SCOPE;
    }
 
    void Renderer::enableVSync() {
@@ -74,7 +74,7 @@ namespace gears {
       VkRenderPass _renderPass;
 
       std::vector<VkImage> _depthImages;
-      std::vector<VkDeviceMemory> _depthImageMemorys;
+      std::vector<Allocation> _depthImageMemorys;
       std::vector<VkImageView> _depthImageViews;
       std::vector<VkImage> _swapChainImages;
       std::vector<VkImageView> _swapChainImageViews;
@@ -128,8 +128,7 @@ namespace gears {
 
       for (int i = 0; i < _depthImages.size(); i++) {
          vkDestroyImageView(_device.device(), _depthImageViews[i], nullptr);
-         vkDestroyImage(_device.device(), _depthImages[i], nullptr);
-         vkFreeMemory(_device.device(), _depthImageMemorys[i], nullptr);
+         _device.destroyImage(_depthImages[i], _depthImageMemorys[i]);
       }
 
       for (auto framebuffer : _swapChainFramebuffers) {
@@ -0,0 +1,69 @@
+module;
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+export module engine.threadPool;
+
+namespace gears {
+
+   export class ThreadPool {
+   public:
+      // threadCount 0 leaves one hardware thread to the main loop
+      ThreadPool(uint32_t threadCount = 0);
+      ~ThreadPool() = default;
+
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      // jobs still queued when the pool is destroyed are discarded, running ones are joined
+      void submit(std::function<void()> job);
+
+      uint32_t threadCount() const { return static_cast<uint32_t>(_workers.size()); }
+
+   private:
+      void _workerLoop(std::stop_token stopToken);
+
+      std::mutex _mutex;
+      std::condition_variable_any _condition;
+      std::deque<std::function<void()>> _jobs;
+      std::vector<std::jthread> _workers; // declared last so the workers are joined before anything else is destroyed
+   };
+
+   //  ========================================== implementation ==========================================
+
+   ThreadPool::ThreadPool(uint32_t threadCount) {
+      if (threadCount == 0) threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+      _workers.reserve(threadCount);
+      for (uint32_t i = 0; i < threadCount; i++) _workers.emplace_back([this](std::stop_token stopToken) { _workerLoop(stopToken); });
+   }
+
+   void ThreadPool::submit(std::function<void()> job) {
+      {
+         std::lock_guard lock{_mutex};
+         _jobs.push_back(std::move(job));
+      }
+      _condition.notify_one();
+   }
+
+   void ThreadPool::_workerLoop(std::stop_token stopToken) {
+      while (!stopToken.stop_requested()) {
+         std::function<void()> job;
+         {
+            std::unique_lock lock{_mutex};
+            if (!_condition.wait(lock, stopToken, [this] { return !_jobs.empty(); })) return;
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+         }
+         job();
+      }
+   }
+} // namespace gears
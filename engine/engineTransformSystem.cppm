@@ -0,0 +1,531 @@
+module;
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRS_TRANSFORM_SSE
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define GRS_TARGET_AVX2
+#else
+#define GRS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif // defined(_MSC_VER) && !defined(__clang__)
+#endif // SSE2
+
+export module engine.transformSystem;
+import engine.gameObject;
+import engine.logger;
+
+namespace gears {
+
+   // structure of arrays store for the transforms of the rendered game objects, keyed by the object id.
+   // setters only flag the entity as dirty, update() recomputes the model and normal matrices of the dirty
+   // entities in batches using the widest instruction set available. the matrices match
+   // TransformComponent::mat4() and normalMatrix(), rotation included (x, y and z used as euler angles)
+   export class TransformSystem {
+   public:
+      using id_t = EngineGameObject::id_t;
+
+      enum class Kernel {
+         Scalar,
+         SSE,
+         AVX2,
+      };
+
+      TransformSystem();
+
+      TransformSystem(const TransformSystem&) = delete;
+      TransformSystem& operator=(const TransformSystem&) = delete;
+
+      void add(id_t id, const TransformComponent& transform);
+      void remove(id_t id);
+      void clear();
+      bool contains(id_t id) const { return id < _sparse.size() && _sparse[id] != INVALID_INDEX; }
+      size_t size() const { return _ids.size(); }
+
+      TransformComponent get(id_t id) const;
+      void set(id_t id, const TransformComponent& transform);
+      void setPosition(id_t id, const glm::vec3& position);
+      void setRotation(id_t id, const glm::quat& rotation);
+      void setScale(id_t id, const glm::vec3& scale);
+
+      // the matrices are only up to date after update()
+      const glm::mat4& modelMatrix(id_t id) const { return _modelMatrices[_index(id)]; }
+      // normal matrix in the upper 3x3, laid out like the shader expects it
+      const glm::mat4& normalMatrix(id_t id) const { return _normalMatrices[_index(id)]; }
+
+      // changes every time the entity's transform is set, unique across the whole store so ids
+      // that get removed and added again don't repeat earlier revisions
+      uint64_t revision(id_t id) const { return _revisions[_index(id)]; }
+
+      // recomputes the matrices of every dirty entity and returns how many were dirty
+      size_t update();
+
+      Kernel getKernel() const { return _kernel; }
+      // falls back to the best supported kernel if kernel isn't supported by the cpu
+      void setKernel(Kernel kernel);
+      static bool isSupported(Kernel kernel);
+
+   private:
+      static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+      // throws in every build, an unregistered id would read past _sparse
+      uint32_t _index(id_t id) const {
+         if (!contains(id)) throw Logger::Exception("game object {} has no transform", id);
+         return _sparse[id];
+      }
+      void _markDirty(uint32_t index);
+
+      std::vector<uint32_t> _sparse; // id -> dense index
+      std::vector<id_t> _ids;        // dense index -> id
+
+      std::vector<float> _positionX, _positionY, _positionZ;
+      std::vector<float> _rotationX, _rotationY, _rotationZ, _rotationW;
+      std::vector<float> _scaleX, _scaleY, _scaleZ;
+
+      std::vector<uint8_t> _dirty;
+      size_t _dirtyCount = 0;
+      std::vector<uint64_t> _revisions;
+      uint64_t _revisionCounter = 0;
+
+      std::vector<glm::mat4> _modelMatrices;
+      std::vector<glm::mat4> _normalMatrices;
+
+      Kernel _kernel = Kernel::Scalar;
+   };
+
+   //  ========================================== implementation ==========================================
+
+   // pointers to the first entity of a batch, every kernel computes `count` consecutive entities
+   struct TransformBatch {
+      const float *positionX, *positionY, *positionZ;
+      const float *rotationX, *rotationY, *rotationZ;
+      const float *scaleX, *scaleY, *scaleZ;
+      glm::mat4* modelMatrices;
+      glm::mat4* normalMatrices;
+   };
+
+   // same math as TransformComponent::mat4() and normalMatrix(): Tait-Bryan angles in Y(1), X(2), Z(3) order
+   void computeTransformsScalar(const TransformBatch& batch, uint32_t count) {
+      for (uint32_t i = 0; i < count; i++) {
+         const float c3 = std::cos(batch.rotationZ[i]);
+         const float s3 = std::sin(batch.rotationZ[i]);
+         const float c2 = std::cos(batch.rotationX[i]);
+         const float s2 = std::sin(batch.rotationX[i]);
+         const float c1 = std::cos(batch.rotationY[i]);
+         const float s1 = std::sin(batch.rotationY[i]);
+
+         const glm::mat3 rotation{
+             {c1 * c3 + s1 * s2 * s3, c2 * s3, c1 * s2 * s3 - c3 * s1},
+             {c3 * s1 * s2 - c1 * s3, c2 * c3, c1 * c3 * s2 + s1 * s3},
+             {c2 * s1, -s2, c1 * c2}};
+         const glm::vec3 scale{batch.scaleX[i], batch.scaleY[i], batch.scaleZ[i]};
+         const glm::vec3 invScale = 1.0f / scale;
+
+         batch.modelMatrices[i] = glm::mat4{
+             glm::vec4{scale.x * rotation[0], 0.f},
+             glm::vec4{scale.y * rotation[1], 0.f},
+             glm::vec4{scale.z * rotation[2], 0.f},
+             glm::vec4{batch.positionX[i], batch.positionY[i], batch.positionZ[i], 1.f}};
+         batch.normalMatrices[i] = glm::mat4{glm::mat3{invScale.x * rotation[0], invScale.y * rotation[1], invScale.z * rotation[2]}};
+      }
+   }
+
+#if defined(GRS_TRANSFORM_SSE)
+   // minimax polynomials from cephes sinf/cosf, accurate to a few ulp for |x| < 8192
+   constexpr float FOUR_OVER_PI = 1.27323954473516f;
+   constexpr float PI_OVER_4_PART1 = 0.78515625f;
+   constexpr float PI_OVER_4_PART2 = 2.4187564849853515625e-4f;
+   constexpr float PI_OVER_4_PART3 = 3.77489497744594108e-8f;
+   constexpr float SIN_COEFFICIENTS[] = {-1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f};
+   constexpr float COS_COEFFICIENTS[] = {2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f};
+
+   void sinCosSse(__m128 x, __m128& sin, __m128& cos) {
+      const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000)));
+      __m128 sinSign = _mm_and_ps(x, signMask);
+      x = _mm_andnot_ps(signMask, x);
+
+      // octant of x, rounded up to an even one so the reduced argument lands in [-pi/4, pi/4]
+      __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+      octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+      const __m128 y = _mm_cvtepi32_ps(octant);
+
+      sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29)));
+      const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+      const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+      x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_4_PART1)));
+      x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_4_PART2)));
+      x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_4_PART3)));
+      const __m128 z = _mm_mul_ps(x, x);
+
+      __m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_COEFFICIENTS[0]), z), _mm_set1_ps(COS_COEFFICIENTS[1]));
+      cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_COEFFICIENTS[2]));
+      cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+      cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.f));
+
+      __m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_COEFFICIENTS[0]), z), _mm_set1_ps(SIN_COEFFICIENTS[1]));
+      sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_COEFFICIENTS[2]));
+      sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+      sin = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly)), sinSign);
+      cos = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly)), cosSign);
+   }
+
+   // transposes one matrix column of 4 entities from structure of arrays into the 4 matrices
+   void storeColumnSse(glm::mat4* matrices, int column, __m128 x, __m128 y, __m128 z, __m128 w) {
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+      _mm_storeu_ps(&matrices[0][column].x, x);
+      _mm_storeu_ps(&matrices[1][column].x, y);
+      _mm_storeu_ps(&matrices[2][column].x, z);
+      _mm_storeu_ps(&matrices[3][column].x, w);
+   }
+
+   // computes 4 entities
+   void computeTransformsSse(const TransformBatch& batch) {
+      __m128 s1, c1, s2, c2, s3, c3;
+      sinCosSse(_mm_loadu_ps(batch.rotationY), s1, c1);
+      sinCosSse(_mm_loadu_ps(batch.rotationX), s2, c2);
+      sinCosSse(_mm_loadu_ps(batch.rotationZ), s3, c3);
+
+      const __m128 c1c3 = _mm_mul_ps(c1, c3);
+      const __m128 s1s2 = _mm_mul_ps(s1, s2);
+      const __m128 c1s2 = _mm_mul_ps(c1, s2);
+
+      const __m128 r00 = _mm_add_ps(c1c3, _mm_mul_ps(s1s2, s3));
+      const __m128 r01 = _mm_mul_ps(c2, s3);
+      const __m128 r02 = _mm_sub_ps(_mm_mul_ps(c1s2, s3), _mm_mul_ps(c3, s1));
+      const __m128 r10 = _mm_sub_ps(_mm_mul_ps(c3, s1s2), _mm_mul_ps(c1, s3));
+      const __m128 r11 = _mm_mul_ps(c2, c3);
+      const __m128 r12 = _mm_add_ps(_mm_mul_ps(c1c3, s2), _mm_mul_ps(s1, s3));
+      const __m128 r20 = _mm_mul_ps(c2, s1);
+      const __m128 r21 = _mm_sub_ps(_mm_setzero_ps(), s2);
+      const __m128 r22 = _mm_mul_ps(c1, c2);
+
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 one = _mm_set1_ps(1.f);
+      const __m128 sx = _mm_loadu_ps(batch.scaleX);
+      const __m128 sy = _mm_loadu_ps(batch.scaleY);
+      const __m128 sz = _mm_loadu_ps(batch.scaleZ);
+
+      storeColumnSse(batch.modelMatrices, 0, _mm_mul_ps(sx, r00), _mm_mul_ps(sx, r01), _mm_mul_ps(sx, r02), zero);
+      storeColumnSse(batch.modelMatrices, 1, _mm_mul_ps(sy, r10), _mm_mul_ps(sy, r11), _mm_mul_ps(sy, r12), zero);
+      storeColumnSse(batch.modelMatrices, 2, _mm_mul_ps(sz, r20), _mm_mul_ps(sz, r21), _mm_mul_ps(sz, r22), zero);
+      storeColumnSse(batch.modelMatrices, 3, _mm_loadu_ps(batch.positionX), _mm_loadu_ps(batch.positionY), _mm_loadu_ps(batch.positionZ), one);
+
+      const __m128 isx = _mm_div_ps(one, sx);
+      const __m128 isy = _mm_div_ps(one, sy);
+      const __m128 isz = _mm_div_ps(one, sz);
+
+      storeColumnSse(batch.normalMatrices, 0, _mm_mul_ps(isx, r00), _mm_mul_ps(isx, r01), _mm_mul_ps(isx, r02), zero);
+      storeColumnSse(batch.normalMatrices, 1, _mm_mul_ps(isy, r10), _mm_mul_ps(isy, r11), _mm_mul_ps(isy, r12), zero);
+      storeColumnSse(batch.normalMatrices, 2, _mm_mul_ps(isz, r20), _mm_mul_ps(isz, r21), _mm_mul_ps(isz, r22), zero);
+      storeColumnSse(batch.normalMatrices, 3, zero, zero, zero, one);
+   }
+
+   // the avx2 functions carry their own target attribute so the rest of the engine doesn't need -mavx2,
+   // they're only called after checking the cpu at runtime
+   GRS_TARGET_AVX2 void sinCosAvx2(__m256 x, __m256& sin, __m256& cos) {
+      const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0x80000000)));
+      __m256 sinSign = _mm256_and_ps(x, signMask);
+      x = _mm256_andnot_ps(signMask, x);
+
+      __m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+      octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+      const __m256 y = _mm256_cvtepi32_ps(octant);
+
+      sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29)));
+      const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+      const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+      x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_4_PART1), x);
+      x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_4_PART2), x);
+      x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_4_PART3), x);
+      const __m256 z = _mm256_mul_ps(x, x);
+
+      __m256 cosPoly = _mm256_fmadd_ps(_mm256_set1_ps(COS_COEFFICIENTS[0]), z, _mm256_set1_ps(COS_COEFFICIENTS[1]));
+      cosPoly = _mm256_fmadd_ps(cosPoly, z, _mm256_set1_ps(COS_COEFFICIENTS[2]));
+      cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+      cosPoly = _mm256_add_ps(_mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), cosPoly), _mm256_set1_ps(1.f));
+
+      __m256 sinPoly = _mm256_fmadd_ps(_mm256_set1_ps(SIN_COEFFICIENTS[0]), z, _mm256_set1_ps(SIN_COEFFICIENTS[1]));
+      sinPoly = _mm256_fmadd_ps(sinPoly, z, _mm256_set1_ps(SIN_COEFFICIENTS[2]));
+      sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(sinPoly, z), x, x);
+
+      sin = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, swap), sinSign);
+      cos = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, swap), cosSign);
+   }
+
+   GRS_TARGET_AVX2 void storeColumnAvx2(glm::mat4* matrices, int column, __m256 x, __m256 y, __m256 z, __m256 w) {
+      __m128 lowX = _mm256_castps256_ps128(x), lowY = _mm256_castps256_ps128(y), lowZ = _mm256_castps256_ps128(z), lowW = _mm256_castps256_ps128(w);
+      __m128 highX = _mm256_extractf128_ps(x, 1), highY = _mm256_extractf128_ps(y, 1), highZ = _mm256_extractf128_ps(z, 1), highW = _mm256_extractf128_ps(w, 1);
+      _MM_TRANSPOSE4_PS(lowX, lowY, lowZ, lowW);
+      _MM_TRANSPOSE4_PS(highX, highY, highZ, highW);
+      _mm_storeu_ps(&matrices[0][column].x, lowX);
+      _mm_storeu_ps(&matrices[1][column].x, lowY);
+      _mm_storeu_ps(&matrices[2][column].x, lowZ);
+      _mm_storeu_ps(&matrices[3][column].x, lowW);
+      _mm_storeu_ps(&matrices[4][column].x, highX);
+      _mm_storeu_ps(&matrices[5][column].x, highY);
+      _mm_storeu_ps(&matrices[6][column].x, highZ);
+      _mm_storeu_ps(&matrices[7][column].x, highW);
+   }
+
+   // computes 8 entities
+   GRS_TARGET_AVX2 void computeTransformsAvx2(const TransformBatch& batch) {
+      __m256 s1, c1, s2, c2, s3, c3;
+      sinCosAvx2(_mm256_loadu_ps(batch.rotationY), s1, c1);
+      sinCosAvx2(_mm256_loadu_ps(batch.rotationX), s2, c2);
+      sinCosAvx2(_mm256_loadu_ps(batch.rotationZ), s3, c3);
+
+      const __m256 c1c3 = _mm256_mul_ps(c1, c3);
+      const __m256 s1s2 = _mm256_mul_ps(s1, s2);
+      const __m256 c1s2 = _mm256_mul_ps(c1, s2);
+
+      const __m256 r00 = _mm256_fmadd_ps(s1s2, s3, c1c3);
+      const __m256 r01 = _mm256_mul_ps(c2, s3);
+      const __m256 r02 = _mm256_fmsub_ps(c1s2, s3, _mm256_mul_ps(c3, s1));
+      const __m256 r10 = _mm256_fmsub_ps(c3, s1s2, _mm256_mul_ps(c1, s3));
+      const __m256 r11 = _mm256_mul_ps(c2, c3);
+      const __m256 r12 = _mm256_fmadd_ps(c1c3, s2, _mm256_mul_ps(s1, s3));
+      const __m256 r20 = _mm256_mul_ps(c2, s1);
+      const __m256 r21 = _mm256_sub_ps(_mm256_setzero_ps(), s2);
+      const __m256 r22 = _mm256_mul_ps(c1, c2);
+
+      const __m256 zero = _mm256_setzero_ps();
+      const __m256 one = _mm256_set1_ps(1.f);
+      const __m256 sx = _mm256_loadu_ps(batch.scaleX);
+      const __m256 sy = _mm256_loadu_ps(batch.scaleY);
+      const __m256 sz = _mm256_loadu_ps(batch.scaleZ);
+
+      storeColumnAvx2(batch.modelMatrices, 0, _mm256_mul_ps(sx, r00), _mm256_mul_ps(sx, r01), _mm256_mul_ps(sx, r02), zero);
+      storeColumnAvx2(batch.modelMatrices, 1, _mm256_mul_ps(sy, r10), _mm256_mul_ps(sy, r11), _mm256_mul_ps(sy, r12), zero);
+      storeColumnAvx2(batch.modelMatrices, 2, _mm256_mul_ps(sz, r20), _mm256_mul_ps(sz, r21), _mm256_mul_ps(sz, r22), zero);
+      storeColumnAvx2(batch.modelMatrices, 3, _mm256_loadu_ps(batch.positionX), _mm256_loadu_ps(batch.positionY), _mm256_loadu_ps(batch.positionZ), one);
+
+      const __m256 isx = _mm256_div_ps(one, sx);
+      const __m256 isy = _mm256_div_ps(one, sy);
+      const __m256 isz = _mm256_div_ps(one, sz);
+
+      storeColumnAvx2(batch.normalMatrices, 0, _mm256_mul_ps(isx, r00), _mm256_mul_ps(isx, r01), _mm256_mul_ps(isx, r02), zero);
+      storeColumnAvx2(batch.normalMatrices, 1, _mm256_mul_ps(isy, r10), _mm256_mul_ps(isy, r11), _mm256_mul_ps(isy, r12), zero);
+      storeColumnAvx2(batch.normalMatrices, 2, _mm256_mul_ps(isz, r20), _mm256_mul_ps(isz, r21), _mm256_mul_ps(isz, r22), zero);
+      storeColumnAvx2(batch.normalMatrices, 3, zero, zero, zero, one);
+   }
+
+   bool cpuSupportsAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7) return false;
+      __cpuid(info, 1);
+      const bool fma = info[2] & (1 << 12);
+      const bool osxsave = info[2] & (1 << 27);
+      if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) return false; // the os has to save the ymm registers
+      __cpuidex(info, 7, 0);
+      return info[1] & (1 << 5);
+#else
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif // defined(_MSC_VER) && !defined(__clang__)
+   }
+#endif // defined(GRS_TRANSFORM_SSE)
+
+   bool TransformSystem::isSupported(Kernel kernel) {
+      switch (kernel) {
+#if defined(GRS_TRANSFORM_SSE)
+         case Kernel::AVX2: {
+            static const bool supported = cpuSupportsAvx2();
+            return supported;
+         }
+         case Kernel::SSE: return true;
+#else
+         case Kernel::AVX2:
+         case Kernel::SSE: return false;
+#endif // defined(GRS_TRANSFORM_SSE)
+         case Kernel::Scalar: return true;
+      }
+      return false;
+   }
+
+   TransformSystem::TransformSystem() {
+      if (isSupported(Kernel::AVX2)) _kernel = Kernel::AVX2;
+      else if (isSupported(Kernel::SSE)) _kernel = Kernel::SSE;
+   }
+
+   void TransformSystem::setKernel(Kernel kernel) {
+      while (!isSupported(kernel)) kernel = static_cast<Kernel>(static_cast<int>(kernel) - 1);
+      _kernel = kernel;
+   }
+
+   void TransformSystem::add(id_t id, const TransformComponent& transform) {
+      if (contains(id)) {
+         set(id, transform);
+         return;
+      }
+      if (id >= _sparse.size()) _sparse.resize(id + 1, INVALID_INDEX);
+
+      _sparse[id] = static_cast<uint32_t>(_ids.size());
+      _ids.push_back(id);
+      _positionX.push_back(transform.position.x);
+      _positionY.push_back(transform.position.y);
+      _positionZ.push_back(transform.position.z);
+      _rotationX.push_back(transform.rotation.x);
+      _rotationY.push_back(transform.rotation.y);
+      _rotationZ.push_back(transform.rotation.z);
+      _rotationW.push_back(transform.rotation.w);
+      _scaleX.push_back(transform.scale.x);
+      _scaleY.push_back(transform.scale.y);
+      _scaleZ.push_back(transform.scale.z);
+      _modelMatrices.emplace_back(1.f);
+      _normalMatrices.emplace_back(1.f);
+      _dirty.push_back(0);
+      _revisions.push_back(0);
+      _markDirty(_sparse[id]);
+   }
+
+   void TransformSystem::remove(id_t id) {
+      const uint32_t index = _index(id);
+      const uint32_t last = static_cast<uint32_t>(_ids.size() - 1);
+      if (_dirty[index]) _dirtyCount--;
+
+      // the last entity takes the removed one's place, its matrices move along so it stays clean
+      auto swapRemove = [index](auto& array) {
+         array[index] = array.back();
+         array.pop_back();
+      };
+      swapRemove(_ids);
+      swapRemove(_positionX);
+      swapRemove(_positionY);
+      swapRemove(_positionZ);
+      swapRemove(_rotationX);
+      swapRemove(_rotationY);
+      swapRemove(_rotationZ);
+      swapRemove(_rotationW);
+      swapRemove(_scaleX);
+      swapRemove(_scaleY);
+      swapRemove(_scaleZ);
+      swapRemove(_modelMatrices);
+      swapRemove(_normalMatrices);
+      swapRemove(_dirty);
+      swapRemove(_revisions);
+
+      if (index != last) _sparse[_ids[index]] = index;
+      _sparse[id] = INVALID_INDEX;
+   }
+
+   void TransformSystem::clear() {
+      for (auto* array : {&_positionX, &_positionY, &_positionZ, &_rotationX, &_rotationY, &_rotationZ, &_rotationW, &_scaleX, &_scaleY, &_scaleZ}) array->clear();
+      _sparse.clear();
+      _ids.clear();
+      _dirty.clear();
+      _dirtyCount = 0;
+      _revisions.clear();
+      _modelMatrices.clear();
+      _normalMatrices.clear();
+   }
+
+   TransformComponent TransformSystem::get(id_t id) const {
+      const uint32_t index = _index(id);
+      TransformComponent transform{};
+      transform.position = {_positionX[index], _positionY[index], _positionZ[index]};
+      transform.rotation = glm::quat{_rotationW[index], _rotationX[index], _rotationY[index], _rotationZ[index]};
+      transform.scale = {_scaleX[index], _scaleY[index], _scaleZ[index]};
+      return transform;
+   }
+
+   void TransformSystem::set(id_t id, const TransformComponent& transform) {
+      setPosition(id, transform.position);
+      setRotation(id, transform.rotation);
+      setScale(id, transform.scale);
+   }
+
+   void TransformSystem::setPosition(id_t id, const glm::vec3& position) {
+      const uint32_t index = _index(id);
+      _positionX[index] = position.x;
+      _positionY[index] = position.y;
+      _positionZ[index] = position.z;
+      _markDirty(index);
+   }
+
+   void TransformSystem::setRotation(id_t id, const glm::quat& rotation) {
+      const uint32_t index = _index(id);
+      _rotationX[index] = rotation.x;
+      _rotationY[index] = rotation.y;
+      _rotationZ[index] = rotation.z;
+      _rotationW[index] = rotation.w;
+      _markDirty(index);
+   }
+
+   void TransformSystem::setScale(id_t id, const glm::vec3& scale) {
+      const uint32_t index = _index(id);
+      _scaleX[index] = scale.x;
+      _scaleY[index] = scale.y;
+      _scaleZ[index] = scale.z;
+      _markDirty(index);
+   }
+
+   void TransformSystem::_markDirty(uint32_t index) {
+      _revisions[index] = ++_revisionCounter;
+      if (_dirty[index]) return;
+      _dirty[index] = 1;
+      _dirtyCount++;
+   }
+
+   size_t TransformSystem::update() {
+      const size_t dirtyCount = _dirtyCount;
+      if (dirtyCount == 0) return 0;
+
+      auto batchAt = [this](uint32_t index) {
+         return TransformBatch{
+             &_positionX[index], &_positionY[index], &_positionZ[index],
+             &_rotationX[index], &_rotationY[index], &_rotationZ[index],
+             &_scaleX[index], &_scaleY[index], &_scaleZ[index],
+             &_modelMatrices[index], &_normalMatrices[index]};
+      };
+
+      const uint32_t count = static_cast<uint32_t>(_ids.size());
+      uint32_t index = 0;
+
+#if defined(GRS_TRANSFORM_SSE)
+      // entities are processed in groups of the vector width: a group is skipped when none of its
+      // entities is dirty and recomputed entirely otherwise, clean entities just get the same matrices again
+      if (_kernel == Kernel::AVX2) {
+         for (; index + 8 <= count; index += 8) {
+            uint64_t dirty;
+            memcpy(&dirty, &_dirty[index], sizeof(dirty));
+            if (!dirty) continue;
+            computeTransformsAvx2(batchAt(index));
+            memset(&_dirty[index], 0, sizeof(dirty));
+         }
+      } else if (_kernel == Kernel::SSE) {
+         for (; index + 4 <= count; index += 4) {
+            uint32_t dirty;
+            memcpy(&dirty, &_dirty[index], sizeof(dirty));
+            if (!dirty) continue;
+            computeTransformsSse(batchAt(index));
+            memset(&_dirty[index], 0, sizeof(dirty));
+         }
+      }
+#endif // defined(GRS_TRANSFORM_SSE)
+
+      for (; index < count; index++) {
+         if (!_dirty[index]) continue;
+         computeTransformsScalar(batchAt(index), 1);
+         _dirty[index] = 0;
+      }
+
+      _dirtyCount = 0;
+      return dirtyCount;
+   }
+} // namespace gears
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
 #include <functional>
 
 namespace gears {
@@ -8,4 +10,15 @@ namespace gears {
       seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
       (hashCombine(seed, rest), ...);
    }
-} // namespace gears
\ No newline at end of file
+
+   // 64 bit FNV-1a, used to fingerprint file contents (asset sources, shader code, caches)
+   inline uint64_t hashBytes(const void* data, std::size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+      const auto* bytes = static_cast<const unsigned char*>(data);
+      uint64_t hash = seed;
+      for (std::size_t i = 0; i < size; i++) {
+         hash ^= bytes[i];
+         hash *= 0x100000001b3ull;
+      }
+      return hash;
+   }
+} // namespace gears
@@ -6,6 +6,7 @@ module;
 #include <format>
 #include <iostream>
 #include <chrono>
+#include <mutex>
 #include <string_view>
 
 #define LOGGER_IMPORT
@@ -80,6 +81,7 @@ namespace gears {
    private:
       Levels _logLevel;
       std::ofstream _logFile;
+      std::mutex _mutex; // messages can come from worker threads
 
       void _log(const Levels level, std::string_view message, const std::source_location& location);
    };
@@ -123,6 +125,7 @@ namespace gears {
 
    void Logger::_log(const Levels level, std::string_view message, const std::source_location& location) {
       GRS_ASSERT(logger, "the logger was nullptr");
+      std::lock_guard lock{_mutex};
       if (_logLevel >= level) {
          auto now = std::chrono::system_clock::now();
          auto in_time_t = std::chrono::system_clock::to_time_t(now);
@@ -1,19 +1,53 @@
 ﻿#include <memory>
 #include <cstdlib>
 #include <source_location>
+#include <string>
+#include <vector>
 
 #include "engine.hpp"
 #include "main.hpp"
 #include "macro.hpp"
 import engine.logger;
+import engine.benchmark;
+import engine.profiler;
+import engineModel;
 
 int main(int argc, char** argv) {
    gears::Logger logger{};
+   gears::Profiler profiler{};
 
    try {
+      const std::vector<std::string> args(argv + 1, argv + argc);
+
+      // offline conversion of obj files into the binary mesh cache
+      if (!args.empty() && args[0] == "--convert") {
+         for (size_t i = 1; i < args.size(); i++) gears::EngineModel::convertModel(args[i]);
+         return EXIT_SUCCESS;
+      }
+
+      if (!args.empty() && args[0] == "--benchmark") {
+         gears::runBenchmark(std::vector<std::string>(args.begin() + 1, args.end()));
+         return EXIT_SUCCESS;
+      }
+
+      // renders offscreen without a window, profiled
+      if (!args.empty() && args[0] == "--headless") {
+         gears::runHeadless(std::vector<std::string>(args.begin() + 1, args.end()));
+         return EXIT_SUCCESS;
+      }
+
+      // profiles the interactive run and writes a chrome trace of the last frames when closed
+      const bool profile = !args.empty() && args[0] == "--profile";
+      profiler.setEnabled(profile);
+
       std::unique_ptr<gears::Engine> app = std::make_unique<gears::Engine>(1280, 720, "Gears engine goes brrrrrrrrrrrr");
       app->run();
 
+      if (profile) {
+         profiler.logStatistics();
+         profiler.exportChromeTrace(args.size() > 1 ? args[1] : "profile.json");
+      }
+
    } catch (const gears::Logger::Exception& e) {
       GRS_LOG_EXIT(e.where(), "terminating execution because of exception: {}", e.what());
 
@@ -52,7 +52,7 @@ namespace gears {
          int moveDown = GLFW_KEY_Q;
       };
 
-      void moveInPlaneYXZ(GLFWwindow* window, const Mouse& mouse, float dt, EngineGameObject& gameObject);
+      void moveInPlaneYXZ(GLFWwindow* window, const Mouse& mouse, float dt, TransformComponent& transform);
 
       KeyMappings keys{};
 
@@ -72,13 +72,13 @@ namespace gears {
     *  }
     */
 
-   void MovementController::moveInPlaneYXZ(GLFWwindow* window, const Mouse& mouse, float dt, EngineGameObject& gameObject) {
-      gameObject.transform.rotation = glm::angleAxis(-mouse.deltaX() * mouse.sens(), glm::vec3(0.f, -1.f, 0.f)) * gameObject.transform.rotation;
-      auto pitched_rot = gameObject.transform.rotation * glm::angleAxis(mouse.deltaY() * mouse.sens(), glm::vec3(-1.f, 0.f, 0.f));
+   void MovementController::moveInPlaneYXZ(GLFWwindow* window, const Mouse& mouse, float dt, TransformComponent& transform) {
+      transform.rotation = glm::angleAxis(-mouse.deltaX() * mouse.sens(), glm::vec3(0.f, -1.f, 0.f)) * transform.rotation;
+      auto pitched_rot = transform.rotation * glm::angleAxis(mouse.deltaY() * mouse.sens(), glm::vec3(-1.f, 0.f, 0.f));
       if (glm::dot(pitched_rot * glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 1.f, 0.f)) >= 0.f) {
-         gameObject.transform.rotation = pitched_rot;
+         transform.rotation = pitched_rot;
       }
-      gameObject.transform.rotation = glm::normalize(gameObject.transform.rotation);
+      transform.rotation = glm::normalize(transform.rotation);
 
       glm::vec3 translate{0.0f};
       if (glfwGetKey(window, keys.moveForward) == GLFW_PRESS) translate += glm::vec3(0.f, 0.f, 1.f);
@@ -86,11 +86,11 @@ namespace gears {
       if (glfwGetKey(window, keys.moveRight) == GLFW_PRESS) translate += glm::vec3(1.f, 0.f, 0.f);
       if (glfwGetKey(window, keys.moveLeft) == GLFW_PRESS) translate -= glm::vec3(1.f, 0.f, 0.f);
 
-      if (glfwGetKey(window, keys.moveUp) == GLFW_PRESS) gameObject.transform.position -= glm::vec3(0.f, 1.f, 0.f) * moveSpeed * dt;
-      if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS) gameObject.transform.position += glm::vec3(0.f, 1.f, 0.f) * moveSpeed * dt;
+      if (glfwGetKey(window, keys.moveUp) == GLFW_PRESS) transform.position -= glm::vec3(0.f, 1.f, 0.f) * moveSpeed * dt;
+      if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS) transform.position += glm::vec3(0.f, 1.f, 0.f) * moveSpeed * dt;
 
       if (translate.x || translate.y || translate.z)
-         gameObject.transform.position += gameObject.transform.rotation * (glm::normalize(translate) * moveSpeed * dt);
+         transform.position += transform.rotation * (glm::normalize(translate) * moveSpeed * dt);
    }
 
    Mouse::Mouse(Window& window) : _window{window} {
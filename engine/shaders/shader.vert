@@ -7,20 +7,29 @@ layout(location = 3) in vec2 uv;
 
 layout(location = 0) out vec3 fragColor;
 
-layout(push_constant) uniform Push {
-  mat4 transform; 
+struct Instance {
+  mat4 modelMatrix;
   mat4 normalMatrix;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer {
+  Instance instances[];
+} instanceBuffer;
+
+layout(push_constant) uniform Push {
+  mat4 projectionView;
 } push;
 
 const vec3 DIRECTION_TO_LIGHT = normalize(vec3(1.0, -3.0, -1.0));
 const float AMBIENT = 0.02;
 
 void main() {
-  gl_Position = push.transform * vec4(position, 1.0);
+  Instance instance = instanceBuffer.instances[gl_InstanceIndex];
+  gl_Position = push.projectionView * instance.modelMatrix * vec4(position, 1.0);
 
-  vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * normal);
+  vec3 normalWorldSpace = normalize(mat3(instance.normalMatrix) * normal);
 
   float lightIntensity = AMBIENT + max(dot(normalWorldSpace, DIRECTION_TO_LIGHT), 0);
 
   fragColor = lightIntensity * color;
-}
\ No newline at end of file
+}